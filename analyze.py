@@ -0,0 +1,152 @@
+"""Mapping quality over a directory of rehearsal traces.
+
+Replays every trace (see tracefile.py) through the firmware itself for each
+point of a parameter grid, and prints one comparison table. The replay is
+test/replay.cpp, built natively with the test suite:
+  cmake -S test -B build-test && cmake --build build-test
+It boots midi/main.cpp with theremini.cfg and feeds the recorded samples,
+temperature readings and gyro reads back in at their recorded times, so
+offsets, temperature offsets, oversampling and its decimation, the gyro,
+note quantizing and resting all run as they did on the device. Motion
+rejection is a build option, so there are two binaries, replay and
+replay_raw. Every trace and grid point is one replay run, and the runs are
+spread over a pool of worker processes.
+
+The trace holds the raw samples, not the settings the device played with:
+pass the theremini.cfg it used with --config. The grid points are added as
+config lines after it.
+
+usage: python analyze.py DIR [--config FILE] [--smoothing 1,0.5]
+                             [--rejection 0,1] [--quantize 0,12,6]
+                             [--clock BPM] [--replay DIR] [--workers N]
+                             [--csv FILE]
+"""
+import argparse
+import collections
+import csv
+import itertools
+import json
+import multiprocessing
+import os
+import subprocess
+import sys
+import time
+
+
+class Stats:
+    """Sums for one grid point, added up across traces."""
+
+    def __init__(self):
+        self.seconds = 0.0
+        self.samples = 0
+        self.changes = 0
+        self.spurious = 0  # note changes the unfiltered roll never asked for
+        self.near_edge = 0
+        self.latency_ms = []
+        self.velocity = []
+
+    def add(self, result):
+        self.seconds += result["seconds"]
+        self.samples += result["samples"]
+        self.changes += result["changes"]
+        self.spurious += result["spurious"]
+        self.near_edge += result["near_edge"]
+        self.latency_ms += result["latency_ms"]
+        self.velocity += result["velocity"]
+
+    @staticmethod
+    def _percentile(values, fraction):
+        if not values:
+            return "-"
+        ordered = sorted(values)
+        return str(ordered[min(len(ordered) - 1, int(fraction * len(ordered)))])
+
+    def row(self):
+        per_second = 1.0 / self.seconds if self.seconds else 0.0
+        return {
+            "changes/s": f"{self.changes * per_second:.2f}",
+            "spurious/s": f"{self.spurious * per_second:.2f}",
+            "near edge %": f"{100.0 * self.near_edge / self.samples:.1f}" if self.samples else "-",
+            "latency p50 ms": self._percentile(self.latency_ms, 0.5),
+            "latency p90 ms": self._percentile(self.latency_ms, 0.9),
+            "velocity p50": self._percentile(self.velocity, 0.5),
+        }
+
+
+def replay(job):
+    """One worker run: one trace through the firmware at one grid point."""
+    binary, path, index, args = job
+    done = subprocess.run([binary, path, *args], capture_output=True, text=True)
+    if done.returncode:
+        raise RuntimeError(f"{os.path.basename(path)}: {done.stderr.strip()}")
+    return path, index, json.loads(done.stdout)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Sweep mapping settings over a directory of traces.")
+    parser.add_argument("directory")
+    parser.add_argument("--config", help="the theremini.cfg the traces were played with")
+    parser.add_argument("--smoothing", default="1,0.5,0.25,0.125", help="newest-angle weights, 1 is no smoothing")
+    parser.add_argument("--rejection", default="0,1", help="motion rejection off/on")
+    parser.add_argument("--quantize", default="0", help="quantize grids in clock ticks, 0 off, 12 eighths, 6 sixteenths")
+    parser.add_argument("--clock", type=float, default=0.0,
+                        help="feed an external MIDI clock at this tempo; without one only the beat tracker's clock runs")
+    parser.add_argument("--replay", default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "build-test"),
+                        help="directory holding the replay and replay_raw binaries")
+    parser.add_argument("--workers", type=int, default=os.cpu_count())
+    parser.add_argument("--csv", help="also write the table here")
+    args = parser.parse_args()
+
+    paths = sorted(os.path.join(args.directory, name) for name in os.listdir(args.directory)
+                   if name.endswith(".trc"))
+    if not paths:
+        print(f"no .trc files in {args.directory}")
+        return 1
+    binaries = {rejection: os.path.join(args.replay, "replay" if rejection else "replay_raw") for rejection in (0, 1)}
+    for binary in binaries.values():
+        if not os.access(binary, os.X_OK):
+            print(f"no {binary}, build it with: cmake -S test -B build-test && cmake --build build-test")
+            return 1
+    grid = list(itertools.product(args.smoothing.split(","), [int(r) for r in args.rejection.split(",")],
+                                  [int(q) for q in args.quantize.split(",")]))
+    common = ["--config", args.config] if args.config else []
+    if args.clock:
+        common += ["--clock", str(args.clock)]
+    jobs = [(binaries[rejection], path, index, common + ["--set", f"smoothing {smoothing}", "--quantize", str(quantize)])
+            for path in paths for index, (smoothing, rejection, quantize) in enumerate(grid)]
+
+    start = time.perf_counter()
+    totals = [Stats() for _ in grid]
+    left = collections.Counter(path for _, path, _, _ in jobs)
+    with multiprocessing.Pool(min(args.workers, len(jobs))) as pool:
+        for path, index, result in pool.imap_unordered(replay, jobs):
+            totals[index].add(result)
+            left[path] -= 1
+            if not left[path]:
+                bad = result["bad_blocks"]
+                note = f", {bad} bad blocks skipped" if bad else ""
+                print(f"{os.path.basename(path)}: {result['seconds']:.0f} s{note}", file=sys.stderr)
+    elapsed = time.perf_counter() - start
+
+    rows = []
+    for (smoothing, rejection, quantize), stats in zip(grid, totals):
+        row = {"smoothing": smoothing, "rejection": str(rejection), "quantize": str(quantize)}
+        row.update(stats.row())
+        rows.append(row)
+    columns = list(rows[0])
+    widths = [max(len(c), *(len(r[c]) for r in rows)) for c in columns]
+    print("  ".join(c.rjust(w) for c, w in zip(columns, widths)))
+    for row in rows:
+        print("  ".join(row[c].rjust(w) for c, w in zip(columns, widths)))
+    print(f"{len(paths)} traces, {totals[0].seconds / 60:.1f} min each setting, "
+          f"{len(grid)} settings in {elapsed:.1f} s", file=sys.stderr)
+    if args.csv:
+        with open(args.csv, "w", newline="") as out:
+            writer = csv.DictWriter(out, fieldnames=columns)
+            writer.writeheader()
+            writer.writerows(rows)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
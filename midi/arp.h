@@ -0,0 +1,101 @@
+#pragma once
+#include <stdint.h> // For int types
+#include "scale.h"
+
+#define ARP_CHORD_TONES 4          // root, third, fifth, octave
+#define ARP_MAX_STEPS 6
+#define ARP_SLOWEST_US 500000u     // step interval with the hand fully down
+#define ARP_FASTEST_US 80000u      // step interval with the hand fully up
+#define ARP_STEPS_PER_TAP 2        // tapped tempo is a quarter note, steps are 8ths
+#define ARP_TAP_TIMEOUT_MS 2000    // a longer gap starts a new tap
+#define ARP_TAP_HOLD_MS 8000       // tapped tempo lasts this long after the last tap
+
+enum ArpPattern {
+    ARP_UP,
+    ARP_DOWN,
+    ARP_UP_DOWN,
+    ARP_RANDOM,
+
+    ARP_PATTERN_COUNT,
+};
+
+// Chord tone order for each pattern. Random only uses the length.
+static const uint8_t ARP_PATTERN_STEPS[ARP_PATTERN_COUNT][ARP_MAX_STEPS] = {
+    {0, 1, 2, 3},
+    {3, 2, 1, 0},
+    {0, 1, 2, 3, 2, 1},
+    {0},
+};
+static const uint8_t ARP_PATTERN_LENGTH[ARP_PATTERN_COUNT] = {4, 4, 6, 4};
+
+// Steps through a chord built on the scale degree the roll zone selects.
+// The chord is rebuilt only when the root degree changes, and each step is a
+// table lookup, so nothing is allocated or recomputed per step.
+struct Arpeggiator {
+    uint8_t pattern; // ArpPattern
+    uint8_t step;
+    uint8_t tone;    // last chord tone played
+    uint8_t degree;  // scale degree the chord is built on
+    uint8_t chord[ARP_CHORD_TONES];
+    uint8_t tapped;  // tempo comes from taps instead of the pitch angle
+    uint32_t last_tap_ms;
+    uint32_t interval_us;
+    uint32_t next_us;
+
+    void build(int root_degree, const ScaleQuantizer &scale) {
+        degree = static_cast<uint8_t>(root_degree);
+        chord[0] = scale.note(root_degree);
+        chord[1] = scale.note(root_degree + 2);
+        chord[2] = scale.note(root_degree + 4);
+        chord[3] = static_cast<uint8_t>(chord[0] + 12);
+    }
+
+    void setRoot(int root_degree, const ScaleQuantizer &scale) {
+        if (root_degree != degree) {
+            build(root_degree, scale);
+        }
+    }
+
+    // Pitch angle in degrees, -30 (down, slow) to 30 (up, fast). A tapped
+    // tempo keeps it out until ARP_TAP_HOLD_MS without a tap.
+    void setRateFromPitch(double pitch, uint32_t now_ms) {
+        if (tapped && now_ms - last_tap_ms < ARP_TAP_HOLD_MS) {
+            return;
+        }
+        tapped = 0;
+        if (pitch < -30.0) {
+            pitch = -30.0;
+        } else if (pitch > 30.0) {
+            pitch = 30.0;
+        }
+        double span = static_cast<double>(ARP_SLOWEST_US - ARP_FASTEST_US);
+        interval_us = ARP_SLOWEST_US - static_cast<uint32_t>((pitch + 30.0) / 60.0 * span);
+    }
+
+    // Tap tempo: the gap between two taps is one beat.
+    void tap(uint32_t now_ms) {
+        uint32_t gap = now_ms - last_tap_ms;
+        last_tap_ms = now_ms;
+        if (gap >= ARP_TAP_TIMEOUT_MS) {
+            return;
+        }
+        uint32_t interval = gap * 1000u / ARP_STEPS_PER_TAP;
+        if (interval < ARP_FASTEST_US) {
+            interval = ARP_FASTEST_US;
+        }
+        interval_us = interval;
+        tapped = 1;
+    }
+
+    // Next note of the pattern. random is any wilirand() value; the random
+    // pattern never repeats the previous tone so every step is a new onset.
+    uint8_t nextNote(uint32_t random) {
+        if (pattern == ARP_RANDOM) {
+            tone = static_cast<uint8_t>((tone + 1 + random % (ARP_CHORD_TONES - 1)) % ARP_CHORD_TONES);
+        } else {
+            tone = ARP_PATTERN_STEPS[pattern][step];
+        }
+        step = static_cast<uint8_t>((step + 1) % ARP_PATTERN_LENGTH[pattern]);
+        return chord[tone];
+    }
+};
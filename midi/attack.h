@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Note-on velocity from how decisively the hand moved into the note. The
+// angular speed of every sample feeds a decaying peak hold, so the speed of
+// the last few samples is known at any time in O(1) without keeping or
+// rescanning any history.
+#define ATTACK_DECAY_SHIFT 3    // the peak loses 1/8 per sample, ~80 ms memory at 100 Hz
+#define ATTACK_SLOW_DPS 30      // this slow or slower is a drift, softest attack
+#define ATTACK_FAST_DPS 600     // this fast or faster is full velocity
+#define ATTACK_MIN_VELOCITY 32
+
+struct AttackTracker {
+    double last_roll;
+    double last_pitch;
+    uint32_t last_ms;
+    uint32_t peak_dps; // decaying running maximum of the angular speed
+    uint8_t primed;
+
+    void update(uint32_t t_ms, double roll, double pitch) {
+        uint32_t dt_ms = t_ms - last_ms;
+        if (primed && dt_ms > 0) {
+            double d_roll = roll > last_roll ? roll - last_roll : last_roll - roll;
+            double d_pitch = pitch > last_pitch ? pitch - last_pitch : last_pitch - pitch;
+            // |v| ~ max + min / 2, close enough to the hypotenuse for this
+            double moved = d_roll > d_pitch ? d_roll + d_pitch / 2 : d_pitch + d_roll / 2;
+            uint32_t speed = static_cast<uint32_t>(moved * 1000.0 / dt_ms);
+            peak_dps -= peak_dps >> ATTACK_DECAY_SHIFT;
+            if (speed > peak_dps) {
+                peak_dps = speed;
+            }
+        }
+        last_roll = roll;
+        last_pitch = pitch;
+        last_ms = t_ms;
+        primed = 1;
+    }
+
+    uint8_t velocity() const {
+        if (peak_dps <= ATTACK_SLOW_DPS) {
+            return ATTACK_MIN_VELOCITY;
+        }
+        if (peak_dps >= ATTACK_FAST_DPS) {
+            return 127;
+        }
+        return static_cast<uint8_t>(ATTACK_MIN_VELOCITY + (peak_dps - ATTACK_SLOW_DPS) * (127 - ATTACK_MIN_VELOCITY) /
+                                                               (ATTACK_FAST_DPS - ATTACK_SLOW_DPS));
+    }
+};
@@ -0,0 +1,178 @@
+#pragma once
+#include <stdint.h> // For int types
+#include "ring.h"
+
+// Conducting beat tracking: find the ictus (the sharp turn at the bottom of
+// each beat) in the accelerometer stream and lock a tempo PLL onto it.
+
+#define BEAT_INPUT_SHIFT 4      // raw counts >> 4, 1 LSB = 1/1024 g
+#define BEAT_BASELINE_SHIFT 4   // gravity estimate follows ~16 samples
+#define BEAT_AVERAGE_SHIFT 5    // motion energy average over ~32 samples
+#define BEAT_MIN_ENERGY 24000   // ~(0.15 g)^2, ignore anything softer
+#define BEAT_THRESHOLD_SHIFT 2  // a peak must be 4x the average energy
+#define BEAT_REFRACTORY_MS 250  // no two beats closer than 240 BPM
+
+#define PLL_MIN_PERIOD_US 250000u  // 240 BPM
+#define PLL_MAX_PERIOD_US 1500000u // 40 BPM
+#define PLL_LOCK_BEATS 3           // consistent beats before the clock starts
+#define PLL_LOSE_PERIODS 4         // beats missed before the clock stops
+
+// Streaming ictus detector. Each axis is high-passed against a slow running
+// mean so gravity drops out, and the remaining motion energy is searched for
+// a local maximum above an adaptive threshold. The peak is confirmed one
+// sample late, so its timestamp comes from the previous sample in the ring.
+struct BeatDetector {
+    int32_t base_x, base_y, base_z; // running means << BEAT_BASELINE_SHIFT
+    uint32_t average;               // energy average << BEAT_AVERAGE_SHIFT
+    uint32_t energy1, energy2;      // energy of the previous two samples
+    uint32_t last_beat_ms;
+    uint8_t primed;
+
+    // Feed the newest sample of the ring. Returns 1 and sets beat_ms when
+    // the previous sample was an ictus.
+    int update(const SampleRing &ring, uint32_t &beat_ms) {
+        const AccelSample &s = ring.back(0);
+        int32_t x = s.x >> BEAT_INPUT_SHIFT;
+        int32_t y = s.y >> BEAT_INPUT_SHIFT;
+        int32_t z = s.z >> BEAT_INPUT_SHIFT;
+
+        if (!primed) {
+            base_x = x << BEAT_BASELINE_SHIFT;
+            base_y = y << BEAT_BASELINE_SHIFT;
+            base_z = z << BEAT_BASELINE_SHIFT;
+            primed = 1;
+        }
+
+        int32_t dx = x - (base_x >> BEAT_BASELINE_SHIFT);
+        int32_t dy = y - (base_y >> BEAT_BASELINE_SHIFT);
+        int32_t dz = z - (base_z >> BEAT_BASELINE_SHIFT);
+        base_x += dx;
+        base_y += dy;
+        base_z += dz;
+
+        uint32_t energy = static_cast<uint32_t>(dx * dx + dy * dy + dz * dz);
+        uint32_t mean = average >> BEAT_AVERAGE_SHIFT;
+        uint32_t threshold = mean << BEAT_THRESHOLD_SHIFT;
+        if (threshold < BEAT_MIN_ENERGY) {
+            threshold = BEAT_MIN_ENERGY;
+        }
+
+        int found = 0;
+        if (ring.size() >= 3 && energy1 > energy2 && energy1 >= energy && energy1 > threshold) {
+            uint32_t t_ms = ring.back(1).t_ms;
+            if (t_ms - last_beat_ms >= BEAT_REFRACTORY_MS) {
+                last_beat_ms = t_ms;
+                beat_ms = t_ms;
+                found = 1;
+            }
+        }
+
+        average += energy - mean;
+        energy2 = energy1;
+        energy1 = energy;
+        return found;
+    }
+};
+
+// Second order phase-locked loop on the beat period. While acquiring it just
+// measures beat intervals; once PLL_LOCK_BEATS agree it tracks the ictus with
+// small bounded phase and period corrections so the clock derived from it
+// never jumps by more than half a clock tick.
+struct TempoPll {
+    uint32_t period_us;
+    uint32_t beat_us;       // time of the current (or next) beat
+    uint32_t last_ictus_us;
+    uint8_t good_beats;
+    uint8_t has_ictus;
+    uint8_t locked;
+
+    void reset() {
+        good_beats = 0;
+        has_ictus = 0;
+        locked = 0;
+    }
+
+    void ictus(uint32_t t_us) {
+        if (!has_ictus) {
+            has_ictus = 1;
+            last_ictus_us = t_us;
+            beat_us = t_us;
+            return;
+        }
+
+        uint32_t interval = t_us - last_ictus_us;
+        last_ictus_us = t_us;
+
+        if (!locked) {
+            if (interval < PLL_MIN_PERIOD_US || interval > PLL_MAX_PERIOD_US) {
+                good_beats = 0;
+                beat_us = t_us;
+                return;
+            }
+            if (good_beats == 0) {
+                period_us = interval;
+                good_beats = 1;
+            } else {
+                uint32_t diff = interval > period_us ? interval - period_us : period_us - interval;
+                if (diff < period_us / 8) {
+                    period_us = (period_us + interval) / 2;
+                    good_beats++;
+                } else {
+                    period_us = interval;
+                    good_beats = 1;
+                }
+            }
+            beat_us = t_us;
+            if (good_beats >= PLL_LOCK_BEATS) {
+                locked = 1;
+            }
+            return;
+        }
+
+        // Phase error against the nearest predicted beat.
+        int32_t period = static_cast<int32_t>(period_us);
+        int32_t err = static_cast<int32_t>(t_us - beat_us);
+        if (err > period / 2) {
+            err -= period;
+        } else if (err < -period / 2) {
+            err += period;
+        }
+        if (err > period / 4 || err < -period / 4) {
+            return; // far off the grid, treat it as an outlier
+        }
+
+        int32_t phase = err / 4;
+        int32_t max_phase = period / 48;
+        if (phase > max_phase) {
+            phase = max_phase;
+        } else if (phase < -max_phase) {
+            phase = -max_phase;
+        }
+        beat_us += static_cast<uint32_t>(phase);
+
+        int32_t adjust = err / 16;
+        int32_t max_adjust = period / 16;
+        if (adjust > max_adjust) {
+            adjust = max_adjust;
+        } else if (adjust < -max_adjust) {
+            adjust = -max_adjust;
+        }
+        period += adjust;
+        if (period < static_cast<int32_t>(PLL_MIN_PERIOD_US)) {
+            period = PLL_MIN_PERIOD_US;
+        } else if (period > static_cast<int32_t>(PLL_MAX_PERIOD_US)) {
+            period = PLL_MAX_PERIOD_US;
+        }
+        period_us = static_cast<uint32_t>(period);
+    }
+
+    // Called by the clock when it has played a whole beat.
+    void advance() {
+        beat_us += period_us;
+    }
+
+    // True once the conductor has stopped beating for long enough.
+    bool lost(uint32_t now_us) const {
+        return locked && now_us - last_ictus_us > PLL_LOSE_PERIODS * period_us;
+    }
+};
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Microphone envelope follower for the breath mode. Audio events are folded
+// into running sums as they are drained; the envelope itself is only
+// updated once per BREATH_BLOCK_SAMPLES, so the per-sample cost is a shift,
+// a multiply-add and a compare.
+//
+// Each FWGUI_EVENT_GUI_AUDIO_DATA event is taken to carry AUDIO_EVENT_SAMPLES
+// signed 16-bit little-endian mic samples.
+#define AUDIO_EVENT_SAMPLES 16
+#define BREATH_BLOCK_SAMPLES 256 // envelope update period
+#define BREATH_INPUT_SHIFT 4     // samples >> 4 keep a block of squares in 32 bits
+#define BREATH_ATTACK_SHIFT 1    // envelope rises halfway per block
+#define BREATH_RELEASE_SHIFT 3   // and falls an eighth of the way
+#define BREATH_GATE 24           // RMS (after the shift) below this is silence
+#define BREATH_FULL 600          // RMS that maps to full volume
+#define BREATH_USE_PEAK 0        // 1 to follow block peaks instead of RMS
+
+static inline uint32_t isqrt32(uint32_t value) {
+    uint32_t root = 0;
+    uint32_t bit = 1u << 30;
+    while (bit > value) {
+        bit >>= 2;
+    }
+    while (bit) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// Counters for the audio path, reported and reset periodically.
+struct AudioLoad {
+    uint32_t events;
+    uint32_t blocks;
+    uint32_t max_batch; // most audio events drained in one loop pass
+    uint32_t capped;    // passes that hit the per-pass audio budget
+};
+
+struct BreathEnvelope {
+    uint32_t sum_sq;
+    uint32_t peak;
+    uint32_t count;
+    uint32_t level;  // smoothed envelope << 8
+    uint8_t volume;  // last mapped MIDI volume
+
+    // Fold one audio event into the current block. Returns 1 when the block
+    // completed and volume was updated.
+    int addEvent(const uint8_t *event_data) {
+        for (int i = 0; i < AUDIO_EVENT_SAMPLES; i++) {
+            int16_t raw = static_cast<int16_t>(event_data[2 * i] | event_data[2 * i + 1] << 8);
+            int32_t s = raw >> BREATH_INPUT_SHIFT;
+            uint32_t mag = static_cast<uint32_t>(s < 0 ? -s : s);
+            sum_sq += mag * mag;
+            if (mag > peak) {
+                peak = mag;
+            }
+        }
+        count += AUDIO_EVENT_SAMPLES;
+        if (count < BREATH_BLOCK_SAMPLES) {
+            return 0;
+        }
+
+#if BREATH_USE_PEAK
+        uint32_t target = peak << 8;
+#else
+        uint32_t target = isqrt32(sum_sq / count) << 8;
+#endif
+        sum_sq = 0;
+        peak = 0;
+        count = 0;
+
+        if (target > level) {
+            level += (target - level) >> BREATH_ATTACK_SHIFT;
+        } else {
+            level -= (level - target) >> BREATH_RELEASE_SHIFT;
+        }
+
+        uint32_t env = level >> 8;
+        if (env <= BREATH_GATE) {
+            volume = 0;
+        } else if (env >= BREATH_FULL) {
+            volume = 127;
+        } else {
+            volume = static_cast<uint8_t>((env - BREATH_GATE) * 127 / (BREATH_FULL - BREATH_GATE));
+        }
+        return 1;
+    }
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include <stdint.h> // For int types
+#include "beat.h"
+#include "sched.h"
+
+// MIDI realtime status bytes
+#define MIDI_CLOCK 0xF8
+#define MIDI_START 0xFA
+#define MIDI_CONTINUE 0xFB
+#define MIDI_STOP 0xFC
+
+#define CLOCK_PPQN 24           // MIDI clock resolution, pulses per quarter note
+#define CLOCK_LOST_POLL_US 10000 // how often to check for a lost beat between ticks
+#define EXT_CLOCK_TIMEOUT_US 500000 // external clock counts as gone after this long without a tick
+
+// MIDI clock generated from the tempo PLL. Every tick has an absolute due
+// time, beat_us + tick * period / 24, so the output never accumulates the
+// arrival jitter of the sensor events; it is only late by however long the
+// main loop takes to notice the deadline (about a millisecond).
+struct MidiClock {
+    uint8_t running;
+    uint8_t tick;    // next tick within the beat, 0..CLOCK_PPQN-1
+    uint32_t ticks;  // ticks since start
+
+    uint32_t tickDue(const TempoPll &pll) const {
+        return pll.beat_us + static_cast<uint32_t>((static_cast<uint64_t>(pll.period_us) * tick) / CLOCK_PPQN);
+    }
+
+    // Returns the realtime byte to send now, or 0 if there is nothing due.
+    uint8_t service(uint32_t now_us, TempoPll &pll) {
+        if (!running) {
+            if (!pll.locked) {
+                return 0;
+            }
+            // First tick lands on the next predicted beat.
+            while (timeReached(now_us, pll.beat_us)) {
+                pll.advance();
+            }
+            running = 1;
+            tick = 0;
+            ticks = 0;
+            return MIDI_START;
+        }
+
+        if (pll.lost(now_us)) {
+            running = 0;
+            pll.reset();
+            return MIDI_STOP;
+        }
+
+        if (!timeReached(now_us, tickDue(pll))) {
+            return 0;
+        }
+        ticks++;
+        if (++tick == CLOCK_PPQN) {
+            tick = 0;
+            pll.advance();
+        }
+        return MIDI_CLOCK;
+    }
+
+    // Only meaningful while running; a stopped clock waits for the PLL to lock.
+    uint32_t nextDue(uint32_t now_us, const TempoPll &pll) const {
+        uint32_t due = tickDue(pll);
+        // Keep watching for a lost beat even if the next tick is far away.
+        if (!timeReached(now_us + CLOCK_LOST_POLL_US, due)) {
+            return now_us + CLOCK_LOST_POLL_US;
+        }
+        return due;
+    }
+
+    // Tempo in BPM for reporting; the hot path only ever uses period_us.
+    static float bpm(const TempoPll &pll) {
+        return 60000000.0f / static_cast<float>(pll.period_us);
+    }
+};
+
+// Clock received from another MIDI device. Ticks are timestamped as they are
+// read and the interval is smoothed, so the next tick can be predicted even
+// though bytes are only picked up once per main loop pass.
+struct ExternalClock {
+    uint8_t running;      // between Start/Continue and Stop
+    uint8_t has_tick;
+    uint32_t ticks;       // ticks since Start
+    uint32_t last_tick_us;
+    uint32_t interval_us; // smoothed tick interval
+
+    void start() {
+        running = 1;
+        ticks = 0;
+    }
+
+    void resume() {
+        running = 1;
+    }
+
+    void stop() {
+        running = 0;
+    }
+
+    // Returns 1 when the tick advanced the song position.
+    int tick(uint32_t now_us) {
+        uint32_t interval = now_us - last_tick_us;
+        if (has_tick && interval < EXT_CLOCK_TIMEOUT_US) {
+            if (interval_us == 0) {
+                interval_us = interval;
+            } else {
+                // 1/8 weight per tick, the average spans about a third of a beat
+                int32_t err = static_cast<int32_t>(interval - interval_us);
+                interval_us = static_cast<uint32_t>(static_cast<int32_t>(interval_us) + err / 8);
+            }
+        }
+        has_tick = 1;
+        last_tick_us = now_us;
+
+        if (!running) {
+            return 0;
+        }
+        ticks++;
+        return 1;
+    }
+
+    bool active(uint32_t now_us) const {
+        return running && has_tick && now_us - last_tick_us < EXT_CLOCK_TIMEOUT_US;
+    }
+
+    float bpm() const {
+        if (interval_us == 0) {
+            return 0.0f;
+        }
+        return 60000000.0f / static_cast<float>(interval_us * CLOCK_PPQN);
+    }
+};
@@ -0,0 +1,173 @@
+#pragma once
+#include <stdint.h> // For int types
+#include "params.h"
+
+// Host to device commands, carried as MIDI SysEx on the UART so they share
+// the port with clock and never confuse another MIDI device:
+//   F0 7D <command> <data...> F7
+// 7D is the non-commercial manufacturer ID. Data bytes are 7 bit; signed
+// values are sent as value + 8192 in two bytes, low 7 bits first. Realtime
+// bytes may arrive in the middle of a message and are handled as usual.
+#define SYSEX_START 0xF0
+#define SYSEX_END 0xF7
+#define SYSEX_MANUFACTURER 0x7D
+#define SYSEX_MAX 32 // longest message body, the zone command is 15 bytes
+
+enum CommandId {
+    CMD_SCALE = 1,   // scale, root
+    CMD_ZONES,       // 7 x 14 bit edge in tenths of a degree
+    CMD_FILTER,      // 14 bit smoothing weight, 1..256
+    CMD_VOLUME,      // 14 bit pitch for volume 0, 14 bit pitch for volume 127
+    CMD_SENSOR_RATE, // ms between samples
+    CMD_OUTPUT,      // OutputFormat
+    CMD_COMMIT,      // apply everything staged so far at the next sample
+    CMD_RESET,       // drop everything staged so far
+    CMD_PATTERN,     // ArpPattern, applies at once
+};
+
+// Splits SysEx messages out of the byte stream. Bodies longer than SYSEX_MAX
+// are dropped whole rather than truncated. Line noise costs at most the
+// message it lands in: F0 always starts over, and anything else out of place
+// ends the message and is skipped up to the next F0. broken counts each such
+// corruption once and lost_bytes what was skipped because of it.
+struct SysexParser {
+    uint8_t body[SYSEX_MAX];
+    uint8_t length;
+    uint8_t active;
+    uint8_t overflow;
+    uint8_t stray;       // skipping bytes outside any message
+    uint32_t frames;     // complete messages
+    uint32_t broken;
+    uint32_t lost_bytes;
+
+    // The message in progress is lost; count it and what ended it.
+    void drop(uint32_t extra) {
+        if (!overflow) {
+            broken++;
+            lost_bytes += 1u + length; // F0 and the body so far
+        }
+        lost_bytes += extra;
+        active = 0;
+    }
+
+    // Feed one non-realtime byte. Returns true when body holds a complete
+    // message (without F0 and F7).
+    bool feed(uint8_t byte) {
+        if (byte == SYSEX_START) {
+            if (active) {
+                drop(0); // the previous message lost its F7
+            }
+            active = 1;
+            overflow = 0;
+            stray = 0;
+            length = 0;
+            return false;
+        }
+        if (!active) {
+            lost_bytes++;
+            if (!stray) {
+                stray = 1;
+                broken++;
+            }
+            return false;
+        }
+        if (byte == SYSEX_END) {
+            active = 0;
+            if (overflow) {
+                lost_bytes++;
+                return false;
+            }
+            frames++;
+            return true;
+        }
+        if (byte & 0x80) {
+            drop(1); // any other status byte aborts the message
+            stray = 1;
+            return false;
+        }
+        if (length == SYSEX_MAX) {
+            if (!overflow) {
+                drop(1);
+                active = 1;
+                overflow = 1;
+            } else {
+                lost_bytes++;
+            }
+            return false;
+        }
+        body[length++] = byte;
+        return false;
+    }
+};
+
+static inline int16_t sysexSigned(const uint8_t *data) {
+    return static_cast<int16_t>((data[0] | data[1] << 7) - 8192);
+}
+
+// Applies one message to the staged parameters. Returns the PARAM_ group it
+// changed, 0 for a message that is not ours, or -1 for a malformed or out of
+// range command, which leaves staged untouched.
+static inline int stageCommand(MappingParams &staged, const uint8_t *body, int length) {
+    if (length < 2 || body[0] != SYSEX_MANUFACTURER) {
+        return 0;
+    }
+    const uint8_t *data = body + 2;
+    int data_length = length - 2;
+    MappingParams next = staged;
+    int group;
+    switch (body[1]) {
+    case CMD_SCALE:
+        if (data_length != 2) {
+            return -1;
+        }
+        next.scale = data[0];
+        next.root = data[1];
+        group = PARAM_SCALE;
+        break;
+    case CMD_ZONES:
+        if (data_length != 2 * (ZONE_COUNT - 1)) {
+            return -1;
+        }
+        for (int i = 0; i < ZONE_COUNT - 1; i++) {
+            next.zone_edges[i] = sysexSigned(data + 2 * i);
+        }
+        group = PARAM_ZONES;
+        break;
+    case CMD_FILTER:
+        if (data_length != 2) {
+            return -1;
+        }
+        next.smoothing_q8 = static_cast<uint16_t>(sysexSigned(data));
+        group = PARAM_FILTER;
+        break;
+    case CMD_VOLUME:
+        if (data_length != 4) {
+            return -1;
+        }
+        next.volume_min_deg = sysexSigned(data);
+        next.volume_max_deg = sysexSigned(data + 2);
+        group = PARAM_VOLUME;
+        break;
+    case CMD_SENSOR_RATE:
+        if (data_length != 1) {
+            return -1;
+        }
+        next.sensor_rate_ms = data[0];
+        group = PARAM_RATE;
+        break;
+    case CMD_OUTPUT:
+        if (data_length != 1) {
+            return -1;
+        }
+        next.output_format = data[0];
+        group = PARAM_OUTPUT;
+        break;
+    default:
+        return -1;
+    }
+    if (!validParams(next)) {
+        return -1;
+    }
+    staged = next;
+    return group;
+}
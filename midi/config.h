@@ -0,0 +1,306 @@
+#pragma once
+#include "fwwasm.h"
+#include <stdint.h> // For int types
+#include "params.h"
+
+// Startup configuration. theremini.cfg holds one setting per line, '#' starts
+// a comment:
+//   scale minor            major, minor, pentatonic or blues
+//   root 57                MIDI note of the first degree, 0..96
+//   zones -60 -40 -20 0 20 40 60    the 7 roll edges between zones, degrees
+//   volume -30 30          pitch for volume 0 and for volume 127
+//   curve 1.5              volume curve exponent, 1 is linear
+//   smoothing 0.5          weight of the newest angle, 1 is no smoothing
+//   offset 12 -40 85       raw accelerometer counts to subtract from x, y, z
+//   tempoffset 31.5 4 -9 20    further counts to subtract at that temperature (C);
+//                          one line per point, ascending, up to TEMP_POINTS_MAX
+//   rate 10                ms between sensor samples
+//   output int             float or int
+//   glide 120              ms to slide between notes with pitch bend, 0 jumps
+//   sync follower          off, leader or follower for a shared radio clock
+//   trace on               record samples and notes to theremini.trc
+//   follow on              retune the root from a hummed note, off by default
+//   plot 100               ms between display plot updates, 20..1000
+// The file is parsed once at boot into MappingParams and the tables built
+// from it; nothing on the sample path ever looks at text.
+#define CONFIG_FILE "theremini.cfg"
+#define CONFIG_LINE_MAX 96
+#define CONFIG_MAX_LINES 64 // stop reading a runaway file
+#define CONFIG_NUMBER_MAX 100000 // whole part, so three decimals still fit an int32
+
+// FatFs style open flags taken by openFile()
+#define FILE_OPEN_READ 0x01
+#define FILE_OPEN_WRITE 0x0A // write, create or truncate
+
+struct ConfigReport {
+    uint8_t found;
+    uint8_t lines;
+    uint8_t ignored;  // lines with an unknown key or a bad value
+    uint8_t rejected; // the result failed validParams and defaults were kept
+    uint32_t parse_ms;
+};
+
+static inline const char *configSkipSpace(const char *text) {
+    while (*text == ' ' || *text == '\t') {
+        text++;
+    }
+    return text;
+}
+
+// Matches a whole word and moves past it.
+static inline bool configWord(const char *&text, const char *word) {
+    const char *p = text;
+    while (*word && *p == *word) {
+        p++;
+        word++;
+    }
+    if (*word || (*p && *p != ' ' && *p != '\t')) {
+        return false;
+    }
+    text = configSkipSpace(p);
+    return true;
+}
+
+// Parses "[-]digits[.digits]" scaled by 10^decimals, so "1.5" with one
+// decimal gives 15. Extra decimals are dropped. Anything but a space or the
+// end of the line straight after the number, or a whole part over
+// CONFIG_NUMBER_MAX, fails.
+static inline bool configNumber(const char *&text, int decimals, int32_t &value) {
+    const char *p = text;
+    bool negative = *p == '-';
+    if (negative) {
+        p++;
+    }
+    if (*p < '0' || *p > '9') {
+        return false;
+    }
+    int32_t result = 0;
+    while (*p >= '0' && *p <= '9') {
+        result = result * 10 + (*p++ - '0');
+        if (result > CONFIG_NUMBER_MAX) {
+            return false;
+        }
+    }
+    if (*p == '.') {
+        p++;
+    }
+    for (int i = 0; i < decimals; i++) {
+        result *= 10;
+        if (*p >= '0' && *p <= '9') {
+            result += *p++ - '0';
+        }
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (*p && *p != ' ' && *p != '\t') {
+        return false;
+    }
+    value = negative ? -result : result;
+    text = configSkipSpace(p);
+    return true;
+}
+
+// Raw accelerometer counts for the three axes
+static inline bool configCounts(int32_t x, int32_t y, int32_t z) {
+    return x >= INT16_MIN && x <= INT16_MAX && y >= INT16_MIN && y <= INT16_MAX && z >= INT16_MIN && z <= INT16_MAX;
+}
+
+// Applies one line. A line that is not understood, out of range or out of
+// order returns false and leaves params alone; blank and comment lines
+// count as fine.
+static inline bool configLine(const char *line, MappingParams &params) {
+    const char *text = configSkipSpace(line);
+    if (*text == 0 || *text == '#') {
+        return true;
+    }
+    int32_t a, b, c;
+    if (configWord(text, "scale")) {
+        static const char *const names[SCALE_COUNT] = {"major", "minor", "pentatonic", "blues"};
+        for (int i = 0; i < SCALE_COUNT; i++) {
+            if (configWord(text, names[i])) {
+                params.scale = static_cast<uint8_t>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+    if (configWord(text, "root")) {
+        if (!configNumber(text, 0, a) || a < 0 || a > ROOT_MAX) {
+            return false;
+        }
+        params.root = static_cast<uint8_t>(a);
+        return true;
+    }
+    if (configWord(text, "zones")) {
+        int16_t edges[ZONE_COUNT - 1];
+        for (int i = 0; i < ZONE_COUNT - 1; i++) {
+            if (!configNumber(text, 1, a) || a < -1800 || a > 1800 || (i > 0 && a <= edges[i - 1])) {
+                return false;
+            }
+            edges[i] = static_cast<int16_t>(a);
+        }
+        for (int i = 0; i < ZONE_COUNT - 1; i++) {
+            params.zone_edges[i] = edges[i];
+        }
+        return true;
+    }
+    if (configWord(text, "volume")) {
+        if (!configNumber(text, 0, a) || !configNumber(text, 0, b) || a < -90 || b > 90 || b <= a) {
+            return false;
+        }
+        params.volume_min_deg = static_cast<int16_t>(a);
+        params.volume_max_deg = static_cast<int16_t>(b);
+        return true;
+    }
+    if (configWord(text, "curve")) {
+        if (!configNumber(text, 1, a) || a < 1 || a > CURVE_MAX_X10) {
+            return false;
+        }
+        params.volume_curve_x10 = static_cast<uint8_t>(a);
+        return true;
+    }
+    if (configWord(text, "smoothing")) {
+        if (!configNumber(text, 3, a) || a <= 0 || a > 1000) {
+            return false;
+        }
+        int32_t weight = (a * SMOOTHING_OFF_Q8 + 500) / 1000;
+        params.smoothing_q8 = static_cast<uint16_t>(weight < 1 ? 1 : weight);
+        return true;
+    }
+    if (configWord(text, "offset")) {
+        if (!configNumber(text, 0, a) || !configNumber(text, 0, b) || !configNumber(text, 0, c) || !configCounts(a, b, c)) {
+            return false;
+        }
+        params.accel_offset[0] = static_cast<int16_t>(a);
+        params.accel_offset[1] = static_cast<int16_t>(b);
+        params.accel_offset[2] = static_cast<int16_t>(c);
+        return true;
+    }
+    if (configWord(text, "tempoffset")) {
+        int32_t t;
+        if (params.temp_points == TEMP_POINTS_MAX || !configNumber(text, 1, t) || !configNumber(text, 0, a) ||
+            !configNumber(text, 0, b) || !configNumber(text, 0, c) || !configCounts(a, b, c) || t < INT16_MIN || t > INT16_MAX ||
+            (params.temp_points && t <= params.temp_table[params.temp_points - 1].temp_x10)) {
+            return false;
+        }
+        TempPoint &point = params.temp_table[params.temp_points++];
+        point.temp_x10 = static_cast<int16_t>(t);
+        point.offset[0] = static_cast<int16_t>(a);
+        point.offset[1] = static_cast<int16_t>(b);
+        point.offset[2] = static_cast<int16_t>(c);
+        return true;
+    }
+    if (configWord(text, "rate")) {
+        if (!configNumber(text, 0, a) || a < SENSOR_RATE_MIN_MS || a > SENSOR_RATE_MAX_MS) {
+            return false;
+        }
+        params.sensor_rate_ms = static_cast<uint8_t>(a);
+        return true;
+    }
+    if (configWord(text, "output")) {
+        if (configWord(text, "float")) {
+            params.output_format = OUTPUT_FLOAT;
+            return true;
+        }
+        if (configWord(text, "int")) {
+            params.output_format = OUTPUT_INT;
+            return true;
+        }
+        return false;
+    }
+    if (configWord(text, "glide")) {
+        if (!configNumber(text, 0, a) || a < 0 || a > GLIDE_MS_MAX) {
+            return false;
+        }
+        params.glide_ms = static_cast<uint16_t>(a);
+        return true;
+    }
+    if (configWord(text, "plot")) {
+        if (!configNumber(text, 0, a) || a < PLOT_RATE_MS_MIN || a > PLOT_RATE_MS_MAX) {
+            return false;
+        }
+        params.plot_ms = static_cast<uint16_t>(a);
+        return true;
+    }
+    if (configWord(text, "follow")) {
+        if (configWord(text, "on")) {
+            params.pitch_follow = 1;
+            return true;
+        }
+        if (configWord(text, "off")) {
+            params.pitch_follow = 0;
+            return true;
+        }
+        return false;
+    }
+    if (configWord(text, "trace")) {
+        if (configWord(text, "on")) {
+            params.trace = 1;
+            return true;
+        }
+        if (configWord(text, "off")) {
+            params.trace = 0;
+            return true;
+        }
+        return false;
+    }
+    if (configWord(text, "sync")) {
+        static const char *const names[SYNC_ROLE_COUNT] = {"off", "leader", "follower"};
+        for (int i = 0; i < SYNC_ROLE_COUNT; i++) {
+            if (configWord(text, names[i])) {
+                params.sync_role = static_cast<uint8_t>(i);
+                return true;
+            }
+        }
+        return false;
+    }
+    return false;
+}
+
+// Reads the config file over params, which should hold the defaults. A file
+// that parses into something invalid leaves params untouched.
+static inline void loadConfig(MappingParams &params, ConfigReport &report) {
+    report = ConfigReport();
+    uint32_t start_ms = millis();
+    int handle = openFile(CONFIG_FILE, FILE_OPEN_READ);
+    if (handle < 0) {
+        return;
+    }
+    report.found = 1;
+
+    MappingParams parsed = params;
+    int size = getFileSize(handle);
+    char line[CONFIG_LINE_MAX];
+    while (report.lines < CONFIG_MAX_LINES && getFilePosition(handle) < size) {
+        int length = CONFIG_LINE_MAX - 1;
+        if (readFileLine(handle, line, &length) <= 0) {
+            break;
+        }
+        if (length < 0) {
+            length = 0;
+        } else if (length > CONFIG_LINE_MAX - 1) {
+            length = CONFIG_LINE_MAX - 1;
+        }
+        // Cut the line ending and any trailing comment
+        line[length] = 0;
+        for (int i = 0; i < length; i++) {
+            if (line[i] == '\r' || line[i] == '\n' || line[i] == '#') {
+                line[i] = 0;
+                break;
+            }
+        }
+        report.lines++;
+        if (!configLine(line, parsed)) {
+            report.ignored++;
+        }
+    }
+    closeFile(handle);
+
+    if (validParams(parsed)) {
+        params = parsed;
+    } else {
+        report.rejected = 1;
+    }
+    report.parse_ms = millis() - start_ms;
+}
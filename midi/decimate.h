@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Oversample and decimate: the accelerometer streams Ratio times faster than
+// the mapping runs, and a cascaded integrator-comb (CIC) filter averages each
+// axis down to the output rate. Averaging Ratio samples takes the sensor
+// noise down by ~sqrt(Ratio) and keeps anything faster than the output rate
+// from aliasing into the angles. Per input sample it is Stages additions per
+// axis, per output Stages subtractions and a shift; no multiplies, no
+// history kept. Integer wrap-around is harmless: the comb differences come
+// out right modulo 2^32 as long as the true output fits, which the bit
+// growth assert guarantees.
+//
+// The impulse response is Stages * (Ratio - 1) + 1 input samples long; more
+// stages trade a little latency for better alias rejection. The first
+// Stages outputs after start are a ramp up from zero.
+template <int Ratio, int Stages>
+struct CicDecimator {
+    static_assert(Ratio >= 2 && (Ratio & (Ratio - 1)) == 0, "ratio must be a power of two, the gain is a shift");
+    static_assert(Stages >= 1, "needs at least one stage");
+
+    static constexpr int log2(int n) {
+        return n > 1 ? 1 + log2(n / 2) : 0;
+    }
+    static constexpr int GAIN_SHIFT = Stages * log2(Ratio); // gain is Ratio^Stages
+    static_assert(16 + GAIN_SHIFT <= 32, "int16 input would overflow the 32 bit registers");
+
+    static constexpr unsigned STAGES = static_cast<unsigned>(Stages);
+
+    uint32_t integrator[3][STAGES];
+    uint32_t comb[3][STAGES];
+    int phase;
+    int16_t out[3];
+
+    // Returns true when out holds a new output sample.
+    bool add(int16_t x, int16_t y, int16_t z) {
+        const int16_t in[3] = {x, y, z};
+        for (int axis = 0; axis < 3; axis++) {
+            uint32_t value = static_cast<uint32_t>(static_cast<int32_t>(in[axis]));
+            for (int stage = 0; stage < Stages; stage++) {
+                integrator[axis][stage] += value;
+                value = integrator[axis][stage];
+            }
+        }
+        if (++phase < Ratio) {
+            return false;
+        }
+        phase = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            uint32_t value = integrator[axis][Stages - 1];
+            for (int stage = 0; stage < Stages; stage++) {
+                uint32_t delta = value - comb[axis][stage];
+                comb[axis][stage] = value;
+                value = delta;
+            }
+            out[axis] = static_cast<int16_t>(static_cast<int32_t>(value) >> GAIN_SHIFT);
+        }
+        return true;
+    }
+};
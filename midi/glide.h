@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Glide between notes: the sounding note is held and pitch bend slides from
+// it to the new one over params.glide_ms. The ramp runs off its own deadline
+// at GLIDE_TICK_US whatever the sensor rate, so the slide sounds the same at
+// 5 ms and at 100 ms sampling. The slope is worked out once per new target;
+// a tick is one add and a shift. A note further away than the bend range
+// is played as a fresh note with the bend back at the center.
+#define GLIDE_TICK_US 5000   // control rate, 200 Hz
+#define GLIDE_BEND_RANGE 12  // semitones at full bend, the host sets the synth to match
+#define GLIDE_BEND_MAX 8191  // 14 bit pitch bend around the center
+#define GLIDE_BEND_CENTER 8192
+#define GLIDE_MS_MAX 2000
+
+struct GlideRamp {
+    uint8_t primed;
+    uint8_t anchor;     // note that is sounding, the bend is relative to it
+    uint8_t target;     // note the ramp ends on
+    uint16_t ticks;     // ticks left in the ramp
+    int32_t bend_q16;   // current bend, Q16
+    int32_t step_q16;   // added every tick
+    int32_t end_q16;    // where the ramp lands, exactly
+    int16_t sent;       // bend the host last got
+    uint32_t next_us;
+
+    // Bend for an interval from the anchor. The divisor is a constant.
+    static inline int32_t bendFor(int semitones) {
+        return semitones * GLIDE_BEND_MAX / GLIDE_BEND_RANGE;
+    }
+
+    // Retarget on every sample; returns the note that should sound. Only a
+    // new target does any work.
+    uint8_t retarget(uint8_t note, uint16_t glide_ms) {
+        if (primed && note == target) {
+            return anchor;
+        }
+        target = note;
+        int semitones = static_cast<int>(note) - static_cast<int>(anchor);
+        uint16_t steps = static_cast<uint16_t>(glide_ms * 1000u / GLIDE_TICK_US);
+        if (!primed || steps == 0 || semitones > GLIDE_BEND_RANGE || semitones < -GLIDE_BEND_RANGE) {
+            primed = 1;
+            anchor = note;
+            ticks = 0;
+            bend_q16 = end_q16 = 0;
+            return note;
+        }
+        end_q16 = bendFor(semitones) << 16;
+        step_q16 = (end_q16 - bend_q16) / steps;
+        ticks = steps;
+        return anchor;
+    }
+
+    // One control tick. Returns false once the ramp has landed.
+    bool tick() {
+        if (ticks == 0) {
+            return false;
+        }
+        if (--ticks == 0) {
+            bend_q16 = end_q16;
+            return false;
+        }
+        bend_q16 += step_q16;
+        return true;
+    }
+
+    bool ramping() const {
+        return ticks > 0;
+    }
+
+    // Signed bend, rounded to the nearest step
+    int16_t bend() const {
+        return static_cast<int16_t>((bend_q16 + 0x8000) >> 16);
+    }
+};
@@ -0,0 +1,77 @@
+#pragma once
+#include "fwwasm.h"
+#include <stdint.h> // For int types
+
+// On-device display. Everything here is throttled: the sensor runs at 100 Hz
+// but the plots only need a few updates per second to be readable, and every
+// setPlotData call is a round trip to the display processor.
+
+#define GUI_PANEL_MAIN 0
+
+// Controls on the main panel
+#define GUI_CONTROL_ANGLES 0     // roll and pitch plot
+#define GUI_CONTROL_OUTPUT 1     // volume and note plot
+#define GUI_CONTROL_GUY_OPEN 2   // performer pictures, one visible at a time
+#define GUI_CONTROL_GUY_CLOSED 3
+
+// Plot data series, one per traced value
+#define PLOT_ROLL 0
+#define PLOT_PITCH 1
+#define PLOT_VOLUME 2   // volume actually sent, after the mode's mapping
+#define PLOT_NOTE 3     // note actually sent
+#define PLOT_CHANNELS 4
+
+#define PLOT_RATE_MS_DEFAULT 50 // 20 Hz display, every 5th sample at 100 Hz
+#define PLOT_RATE_MS_MIN 20     // faster only adds display round trips
+#define PLOT_RATE_MS_MAX 1000
+
+#define MOUTH_OPEN_VOLUME 40     // mouth opens above this volume
+#define MOUTH_CLOSE_VOLUME 24    // and only closes again below this one
+#define MOUTH_MIN_TOGGLE_MS 120  // at most ~8 picture swaps per second
+
+// Averages samples between display updates and sends all series together,
+// so the display cost is PLOT_CHANNELS calls per interval no matter how fast
+// the sensor runs. Averaging (rather than dropping samples) keeps a fast
+// wobble visible as a level instead of aliasing into a slow one.
+struct PlotDecimator {
+    int32_t sum[PLOT_CHANNELS];
+    uint16_t count;
+    uint16_t interval_ms;
+    uint32_t next_ms;
+
+    void add(uint32_t now_ms, const int32_t *values) {
+        for (int i = 0; i < PLOT_CHANNELS; i++) {
+            sum[i] += values[i];
+        }
+        count++;
+        if (static_cast<int32_t>(now_ms - next_ms) < 0) {
+            return;
+        }
+        next_ms = now_ms + interval_ms;
+        for (int i = 0; i < PLOT_CHANNELS; i++) {
+            setPlotData(i, 0, sum[i] / count);
+            sum[i] = 0;
+        }
+        count = 0;
+    }
+};
+
+// Performer picture state. The pictures are loaded once at startup and only
+// swapped when the mouth actually changes, with hysteresis so a volume sitting
+// on the threshold does not flicker and a minimum time between swaps so fast
+// tremolo cannot flood the display.
+struct MouthAnimator {
+    uint8_t open;
+    uint32_t toggled_ms;
+
+    // Returns true when the picture has to change.
+    bool update(uint32_t now_ms, int volume) {
+        bool want_open = open ? volume >= MOUTH_CLOSE_VOLUME : volume > MOUTH_OPEN_VOLUME;
+        if (want_open == static_cast<bool>(open) || now_ms - toggled_ms < MOUTH_MIN_TOGGLE_MS) {
+            return false;
+        }
+        open = want_open;
+        toggled_ms = now_ms;
+        return true;
+    }
+};
@@ -0,0 +1,152 @@
+#pragma once
+#include "fwwasm.h"
+#include <stdint.h> // For int types
+
+// Optional external gyro on I2C (MPU-6050 register map, also MPU-6500/9250
+// and ICM-20600 class parts). The gyro is read in one 6 byte register burst
+// from its own scheduler task, faster than the accelerometer stream, and its
+// rates are integrated in fixed point between accelerometer samples. Each
+// accelerometer sample then pulls the integrated angles a little towards its
+// own tilt (a complementary filter): the gyro follows fast turns without
+// caring about linear acceleration, the accelerometer stops it drifting.
+// The IMU is assumed to be mounted with its x and y axes along the board's.
+#define IMU_ADDRESS 0x68
+#define IMU_REG_GYRO_CONFIG 0x1B
+#define IMU_REG_GYRO_OUT 0x43    // x, y, z rates, big-endian int16
+#define IMU_REG_PWR_MGMT_1 0x6B
+#define IMU_REG_WHO_AM_I 0x75
+#define IMU_GYRO_500DPS 0x08
+#define IMU_COUNTS_PER_DPS_X10 655 // at +-500 deg/s
+#define IMU_PERIOD_US 5000         // 200 Hz gyro, twice the accelerometer rate
+#define IMU_CAL_SAMPLES 64         // bias average at boot, the device must be still
+#define IMU_TIMING_READS 64        // back to back bursts timed at boot, millis() is too coarse for one
+#define IMU_ROLL_SIGN 1            // flip if the IMU is mounted the other way up
+#define IMU_PITCH_SIGN 1
+#define FUSION_ACCEL_Q8 8          // accelerometer share per sample, ~0.3 s to settle at 100 Hz
+
+struct GyroFusion {
+    uint8_t present;
+    uint8_t primed;   // fused angles have been set from the accelerometer
+    int32_t bias[3];  // raw counts at rest
+    int32_t last_rate[3]; // raw counts of the last good read
+    int32_t roll_cdeg; // fused angles in hundredths of a degree
+    int32_t pitch_cdeg;
+    int64_t roll_rem; // counts * us not yet a whole hundredth
+    int64_t pitch_rem;
+    uint32_t last_us;
+
+    // Read cost: the counts are reported and cleared by the caller, the
+    // time per burst is measured once at probe
+    uint32_t reads;
+    uint32_t failures;
+    uint32_t read_us;
+
+    bool readRates(int32_t *rate) {
+        uint8_t raw[6];
+        int ok = i2cRead(IMU_ADDRESS, IMU_REG_GYRO_OUT, raw, 6);
+        reads++;
+        if (!ok) {
+            failures++;
+            return false;
+        }
+        for (int i = 0; i < 3; i++) {
+            rate[i] = static_cast<int16_t>(raw[2 * i] << 8 | raw[2 * i + 1]);
+        }
+        return true;
+    }
+
+    // Look for the IMU, wake it, set the range and measure the gyro bias.
+    bool probe(uint32_t now_us) {
+        uint8_t who = 0;
+        if (!i2cRead(IMU_ADDRESS, IMU_REG_WHO_AM_I, &who, 1) || who == 0 || who == 0xFF) {
+            return false;
+        }
+        uint8_t wake = 0;
+        uint8_t range = IMU_GYRO_500DPS;
+        if (!i2cWrite(IMU_ADDRESS, IMU_REG_PWR_MGMT_1, &wake, 1) ||
+            !i2cWrite(IMU_ADDRESS, IMU_REG_GYRO_CONFIG, &range, 1)) {
+            return false;
+        }
+        int32_t sum[3] = {0, 0, 0};
+        int good = 0;
+        for (int n = 0; n < IMU_CAL_SAMPLES; n++) {
+            int32_t rate[3];
+            if (readRates(rate)) {
+                for (int i = 0; i < 3; i++) {
+                    sum[i] += rate[i];
+                }
+                good++;
+            }
+            waitms(2);
+        }
+        if (good == 0) {
+            return false;
+        }
+        // A burst takes well under a millisecond, so time a batch of them
+        uint32_t start_ms = millis();
+        for (int n = 0; n < IMU_TIMING_READS; n++) {
+            int32_t rate[3];
+            readRates(rate);
+        }
+        read_us = (millis() - start_ms) * 1000u / IMU_TIMING_READS;
+        for (int i = 0; i < 3; i++) {
+            bias[i] = sum[i] / good;
+        }
+        present = 1;
+        primed = 0;
+        roll_rem = 0;
+        pitch_rem = 0;
+        last_us = now_us;
+        return true;
+    }
+
+    // One gyro sample: rotate the fused angles by rate * dt. The remainders
+    // keep slow turns from being truncated away at 200 Hz. Returns false
+    // when the read failed.
+    bool integrate(uint32_t now_us) {
+        uint32_t dt_us = now_us - last_us;
+        last_us = now_us;
+        if (!readRates(last_rate)) {
+            return false;
+        }
+        if (!primed) {
+            return true;
+        }
+        // 65.5 counts per deg/s, so counts * us / 655000 is hundredths of a degree
+        const int64_t scale = IMU_COUNTS_PER_DPS_X10 * 1000LL;
+        roll_rem += IMU_ROLL_SIGN * (last_rate[0] - bias[0]) * static_cast<int64_t>(dt_us);
+        pitch_rem += IMU_PITCH_SIGN * (last_rate[1] - bias[1]) * static_cast<int64_t>(dt_us);
+        roll_cdeg += static_cast<int32_t>(roll_rem / scale);
+        pitch_cdeg += static_cast<int32_t>(pitch_rem / scale);
+        roll_rem %= scale;
+        pitch_rem %= scale;
+        if (roll_cdeg > 18000) {
+            roll_cdeg -= 36000;
+        } else if (roll_cdeg < -18000) {
+            roll_cdeg += 36000;
+        }
+        return true;
+    }
+
+    // Blend in the accelerometer tilt and return the fused angles in place.
+    void fuse(double &roll, double &pitch) {
+        int32_t accel_roll = static_cast<int32_t>(roll * 100.0);
+        int32_t accel_pitch = static_cast<int32_t>(pitch * 100.0);
+        if (!primed) {
+            roll_cdeg = accel_roll;
+            pitch_cdeg = accel_pitch;
+            primed = 1;
+        } else {
+            int32_t d_roll = accel_roll - roll_cdeg;
+            if (d_roll > 18000) {
+                d_roll -= 36000;
+            } else if (d_roll < -18000) {
+                d_roll += 36000;
+            }
+            roll_cdeg += d_roll * FUSION_ACCEL_Q8 / 256;
+            pitch_cdeg += (accel_pitch - pitch_cdeg) * FUSION_ACCEL_Q8 / 256;
+        }
+        roll = roll_cdeg / 100.0;
+        pitch = pitch_cdeg / 100.0;
+    }
+};
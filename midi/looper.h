@@ -0,0 +1,189 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Phrase looper. Layers are recorded from the live note/volume stream into one
+// static byte buffer as (delta ms varint, event byte) pairs:
+//   event byte 1nnnnnnn  note change to n
+//   event byte 0vvvvvvv  volume change to v
+// Volume changes smaller than LOOP_VOLUME_STEP are not recorded, which keeps
+// slow pitch drift from filling the buffer.
+#define LOOP_BUFFER_BYTES 8192
+#define LOOP_MAX_LAYERS 4
+#define LOOP_VOLUME_STEP 4
+#define LOOP_MIN_MS 250    // shorter first layers are treated as a mis-press
+#define LOOP_EVENT_MAX 6   // worst case bytes per event, 5 varint + 1
+
+enum LooperState {
+    LOOP_EMPTY,
+    LOOP_RECORDING, // first layer, sets the loop length
+    LOOP_PLAYING,
+    LOOP_OVERDUB,   // one more layer for exactly one loop length
+};
+
+// Called for every event played back. voice is the layer number plus one;
+// voice 0 is the live output.
+typedef void (*LoopEmitFn)(uint8_t voice, uint8_t note, uint8_t volume);
+
+struct LoopLayer {
+    uint16_t begin;    // byte range in Looper::data
+    uint16_t end;
+    uint16_t cursor;   // next event to play
+    uint8_t note;      // state reached by playback
+    uint8_t volume;
+    uint32_t cycle_ms; // start of the current pass through this layer
+    uint32_t next_ms;  // absolute time of the event at cursor
+};
+
+struct Looper {
+    uint8_t data[LOOP_BUFFER_BYTES];
+    uint16_t used;
+    uint8_t state;
+    uint8_t layer_count;
+    LoopLayer layers[LOOP_MAX_LAYERS];
+    uint32_t length_ms;
+
+    // layer being recorded
+    uint32_t rec_start_ms;
+    uint32_t rec_last_ms;
+    uint8_t rec_note;
+    uint8_t rec_volume;
+
+    void clear() {
+        used = 0;
+        layer_count = 0;
+        state = LOOP_EMPTY;
+    }
+
+    bool write(uint32_t now_ms, uint8_t event) {
+        if (used + LOOP_EVENT_MAX > LOOP_BUFFER_BYTES) {
+            return false;
+        }
+        uint32_t delta = now_ms - rec_last_ms;
+        rec_last_ms = now_ms;
+        while (delta >= 0x80) {
+            data[used++] = static_cast<uint8_t>(delta | 0x80);
+            delta >>= 7;
+        }
+        data[used++] = static_cast<uint8_t>(delta);
+        data[used++] = event;
+        return true;
+    }
+
+    // Start recording a layer. Returns false when there is no room left.
+    bool begin(uint32_t now_ms, uint8_t note, uint8_t volume) {
+        if (layer_count == LOOP_MAX_LAYERS || used + 2 * LOOP_EVENT_MAX > LOOP_BUFFER_BYTES) {
+            return false;
+        }
+        LoopLayer &layer = layers[layer_count];
+        layer.begin = used;
+        rec_start_ms = now_ms;
+        rec_last_ms = now_ms;
+        rec_note = note;
+        rec_volume = volume;
+        // Every pass starts from the state the layer was recorded in
+        write(now_ms, static_cast<uint8_t>(0x80 | note));
+        write(now_ms, volume);
+        state = layer_count == 0 ? LOOP_RECORDING : LOOP_OVERDUB;
+        return true;
+    }
+
+    // Close the layer being recorded and start playing it.
+    void end(uint32_t now_ms) {
+        LoopLayer &layer = layers[layer_count];
+        layer.end = used;
+        if (layer_count == 0) {
+            length_ms = now_ms - rec_start_ms;
+            if (length_ms < LOOP_MIN_MS) {
+                clear();
+                return;
+            }
+        }
+        // The pass that was just recorded ends now, playback picks up from here
+        start(layer, rec_start_ms + length_ms);
+        layer_count++;
+        state = LOOP_PLAYING;
+    }
+
+    // Feed the live output. Overdubs close themselves after one loop length.
+    void record(uint32_t now_ms, uint8_t note, uint8_t volume) {
+        if (state != LOOP_RECORDING && state != LOOP_OVERDUB) {
+            return;
+        }
+        if (state == LOOP_OVERDUB && now_ms - rec_start_ms >= length_ms) {
+            end(now_ms);
+            return;
+        }
+
+        bool ok = true;
+        if (note != rec_note) {
+            rec_note = note;
+            ok = write(now_ms, static_cast<uint8_t>(0x80 | note));
+        }
+        int step = volume > rec_volume ? volume - rec_volume : rec_volume - volume;
+        if (ok && step >= LOOP_VOLUME_STEP) {
+            rec_volume = volume;
+            ok = write(now_ms, volume);
+        }
+        if (!ok) {
+            end(now_ms); // buffer full, keep what fits
+        }
+    }
+
+    // Decode the delta time of the event at the layer cursor.
+    uint32_t peekDelta(const LoopLayer &layer, uint16_t &pos) const {
+        uint32_t delta = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = data[pos++];
+            delta |= static_cast<uint32_t>(byte & 0x7F) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && pos < layer.end);
+        return delta;
+    }
+
+    void start(LoopLayer &layer, uint32_t cycle_ms) {
+        layer.cursor = layer.begin;
+        layer.cycle_ms = cycle_ms;
+        layer.next_ms = cycle_ms;
+    }
+
+    // Play every event that is due and return the time of the next one.
+    // Event times are absolute, so a late call catches up without drift.
+    uint32_t service(uint32_t now_ms, LoopEmitFn emit) {
+        uint32_t next_ms = now_ms + length_ms;
+        for (uint8_t i = 0; i < layer_count; i++) {
+            LoopLayer &layer = layers[i];
+            for (;;) {
+                uint16_t pos = layer.cursor;
+                uint32_t due = layer.next_ms + peekDelta(layer, pos);
+                if (static_cast<int32_t>(now_ms - due) < 0) {
+                    if (static_cast<int32_t>(due - next_ms) < 0) {
+                        next_ms = due;
+                    }
+                    break;
+                }
+                uint8_t event = data[pos++];
+                if (event & 0x80) {
+                    layer.note = static_cast<uint8_t>(event & 0x7F);
+                } else {
+                    layer.volume = event;
+                }
+                layer.next_ms = due;
+                layer.cursor = pos;
+                // Note and volume recorded together go out as one update
+                if (layer.cursor < layer.end) {
+                    uint16_t peek = layer.cursor;
+                    if (peekDelta(layer, peek) == 0) {
+                        continue;
+                    }
+                }
+                emit(static_cast<uint8_t>(i + 1), layer.note, layer.volume);
+                if (layer.cursor >= layer.end) {
+                    start(layer, layer.cycle_ms + length_ms);
+                }
+            }
+        }
+        return next_ms;
+    }
+};
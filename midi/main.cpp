@@ -1,116 +1,1240 @@
 #include "fwwasm.h"
 #include <cmath>    // For atan2, sqrt, fabs
 #include <stdint.h> // For int types
+#include "ring.h"
+#include "sched.h"
+#include "beat.h"
+#include "clock.h"
+#include "quantize.h"
+#include "scale.h"
+#include "arp.h"
+#include "looper.h"
+#include "still.h"
+#include "breath.h"
+#include "pitch.h"
+#include "gui.h"
+#include "remote.h"
+#include "command.h"
+#include "config.h"
+#include "pipeline.h"
+#include "tilt.h"
+#include "attack.h"
+#include "imu.h"
+#include "sync.h"
+#include "trace.h"
+#include "decimate.h"
+#include "ump.h"
 
 // MIDI Note and Channel
 #define MIDI_NOTE 60   // Middle C (C4)
 #define MIDI_CHANNEL 0 // Channel 1 in MIDI
 
+// Send MIDI clock and start/stop out of the UART as raw MIDI bytes. The host
+// bridge gets start/stop/tempo lines either way and can clock the DAW itself.
+#define CLOCK_OUT_UART 1
+
+// Upper bound on events handled per loop() so the scheduler always gets a turn
+#define MAX_EVENTS_PER_LOOP 8
+
+// Send the live voice out of the UART as MIDI 2.0 Universal MIDI Packets
+// instead, clock included. Off by default, a MIDI 1.0 port would not know
+// what to do with them. test/test_ump builds the firmware with it on.
+#ifndef UMP_OUTPUT
+#define UMP_OUTPUT 0
+#endif
+
+// Upper bound on UART bytes parsed per poll, keeps the event drain non-blocking
+#define UART_READ_MAX 16
+
+// Note onset grid at startup, the gray button cycles off / 1/8 / 1/16
+#define QUANTIZE_DEFAULT QUANTIZE_OFF
+
+// Arpeggiator velocity while the pitch angle is setting the tempo
+#define ARP_VELOCITY 100
+
+// Sensor streaming period while playing and while resting
+#define SENSOR_RATE_MS 10
+#define STILL_SENSOR_RATE_MS 100
+
+// Longest main loop sleep while resting. Scheduler deadlines still cut it short.
+#define STILL_SLEEP_MS 50
+
+// Audio events are tiny and frequent, so they get their own per-pass budget
+#define AUDIO_EVENTS_PER_LOOP 32
+
+// How often the audio load counters are printed while the mic streams
+#define AUDIO_REPORT_MS 5000
+
+// Controller the breath envelope and, with attack velocity, the volume are
+// sent on (11 = expression)
+#define EXPRESSION_CC 11
+
+// 0 builds the sample path without the angle smoothing stage
+#define ANGLE_SMOOTHING 1
+
+// 0 takes tilt straight from each sample, arm movement included. The
+// analyze.py replay builds it both ways.
+#ifndef MOTION_REJECTION
+#define MOTION_REJECTION 1
+#endif
+
+// Above 1 the accelerometer streams this many times faster than the mapping
+// runs and a CIC filter decimates to the output rate, the configured sensor
+// rate. A power of two; OVERSAMPLE_STAGES sets the filter length.
+#define OVERSAMPLE_RATIO 1
+#define OVERSAMPLE_STAGES 3
+
+// 1 sets note velocity from how fast the hand moved into the note and sends
+// the volume as expression; 0 sends the volume as velocity
+#define ATTACK_VELOCITY 1
+
+// 1 fuses an external I2C gyro into the tilt when one answers at boot
+#define EXTERNAL_IMU 1
+
+// How often the gyro read cost is printed while the IMU runs
+#define IMU_REPORT_MS 5000
+
+// Two yellow presses closer than this clear the looper
+#define LOOP_DOUBLE_PRESS_MS 400
+
+// Two gray presses closer than this start learning IR remote keys
+#define LEARN_DOUBLE_PRESS_MS 400
+
+// Octaves the remote can shift the scale root by, either way, fewer where
+// the notes would leave MIDI range
+#define OCTAVE_SHIFT_MAX 3
+
+// A "hb" line goes to the host this often, even while resting, so it can
+// release held notes when the link stalls
+#define HEARTBEAT_MS 250
+
+// Decode error counters are printed at most this often, and only when they
+// have moved
+#define DECODE_REPORT_MS 5000
+
+// The Free-Wili runs everything in one 64KB wasm page
+#define WASM_PAGE_BYTES 65536
+
+// Play modes, the blue button cycles through them
+enum PlayMode {
+    MODE_THEREMIN, // roll picks the note, pitch the volume
+    MODE_ARP,      // roll picks the chord, pitch (or tapping green) the tempo
+    MODE_BREATH,   // roll picks the note, the microphone envelope the volume
+
+    MODE_COUNT,
+};
+
+// End of static data, placed by the linker after the stack
+extern "C" unsigned char __heap_base;
+
 int8_t exitApp = 0;
 
-void processAccelData(uint8_t *event_data) {
-    int16_t iX, iY, iZ;
-    float scaleFactor = 32768.0f / 2.0f;
-    //int red=0x30;
-    //int green=0x30;
-    //int blue=0x30;
-    iX = static_cast<int16_t>(event_data[0] | event_data[1] << 8);
-    iY = static_cast<int16_t>(event_data[2] | event_data[3] << 8);
-    iZ = static_cast<int16_t>(event_data[4] | event_data[5] << 8);
-    
-    float x = static_cast<float>(iX) / scaleFactor;
-    float y = static_cast<float>(iY) / scaleFactor;
-    float z = static_cast<float>(iZ) / scaleFactor;
-
-    double roll = atan2(y, z) * 180.0 / M_PI;
-    double pitch = atan2(-x, sqrt(y * y + z * z)) * 180.0 / M_PI;
-   
-    double midi_note = 0.0;
-    double midi_volume = 0.0;
-    int ind = 0;
-
-    // Note calculation logic remains the same
-    if (roll < -90.0) {
-        roll = -90.0;
-        midi_note = 60.0;
-        //red=0x30;
-        //green=0x00;
-        //blue=0x00;
-        ind = 0;
-    } else if (roll >= -90.0 && roll <= -67.5) {
-        midi_note = 60.0;
-        ind = 0;
-        //red=0x30;
-        //green=0x00;
-        //blue=0x00;
-    } else if(roll >= -67.5 && roll <= -45.0) {
-        midi_note = 62.0;
-        ind = 1;
-        //red=0x00;
-        //green=0x30;
-        //blue=0x00;
-    } else if (roll >= -45.0 && roll <= -22.5) {
-        midi_note = 64.0;
-        ind = 2;
-        //red=0x00;
-        //green=0x00;
-        //blue=0x30;
-    } else if (roll >= -22.5 && roll <= 0.0) {
-        midi_note = 65.0;
-        ind = 3;
-        //red=0x30;
-        //green=0x30;
-        //blue=0x00;
-    } else if (roll >= 0.0 && roll <= 22.5) {
-        midi_note = 67.0;
-        ind = 4;
-        //red=0x00;
-        //green=0x30;
-        //blue=0x30;
-    } else if (roll >= 22.5 && roll <= 45.0) {
-        midi_note = 69.0;
-        ind = 5;
-        //red=0x30;
-        //green=0x00;
-        //blue=0x30;
-    } else if (roll >= 45.0 && roll <= 67.5) {
-        midi_note = 71.0;
-        ind=6;
-        //red=0x30;
-        //green=0x30;
-        //blue=0x30;
-    } else if (roll >= 67.5 && roll <= 90.0) {
-        midi_note = 72.0;
-        ind=0;
-        //red=0x30;
-        //green=0x30;
-        //blue=0x00;
-    }
-    if (roll > 90) {
-        roll = 90;
-        midi_note = 72.0;
-        ind=0;
-        //red=0x30;
-        //green=0x30;
-        //blue=0x00;
+SampleRing sample_ring;
+BeatDetector beat_detector;
+TempoPll tempo_pll;
+MidiClock midi_clock;
+ExternalClock ext_clock;
+NoteQuantizer quantizer = {QUANTIZE_DEFAULT, MIDI_NOTE, MIDI_NOTE, 0, 0, 0};
+ScaleQuantizer scale_quantizer = {SCALE_MAJOR, MIDI_NOTE};
+Arpeggiator arp;
+uint8_t play_mode = MODE_THEREMIN;
+Looper looper;
+uint32_t looper_press_ms = 0;
+uint8_t last_note = MIDI_NOTE;
+StillnessDetector stillness = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, 0, STILL_IDLE_MS_DEFAULT, 0, 0};
+
+BreathEnvelope breath;
+AudioLoad audio_load;
+uint32_t audio_report_ms = 0;
+uint8_t sent_expression = 0;
+
+PitchFollower pitch_follower;
+uint8_t pitch_follow = 0; // from params at boot, the remote toggles it
+
+PlotDecimator plotter = {{0, 0, 0, 0}, 0, PLOT_RATE_MS_DEFAULT, 0}; // interval from params at boot
+MouthAnimator mouth;
+int8_t lit_led = -1;
+
+RemoteMap remote;
+RemoteLearner remote_learner;
+uint32_t gray_press_ms = 0;
+uint8_t gray_prev_grid = QUANTIZE_DEFAULT;
+uint8_t root_base = MIDI_NOTE; // root before the octave shift, set by pitch following
+int8_t octave_shift = 0;
+
+// Live mapping, what the host has staged, and what it committed for the next sample
+MappingParams params;
+MappingParams staged_params;
+MappingParams committed_params;
+uint8_t staged_groups = 0;
+uint8_t committed_groups = 0;
+SysexParser sysex;
+uint8_t volume_table[VOLUME_TABLE_SIZE]; // built from params, pitch degree + 90 -> volume
+ConfigReport config_report;
+double smooth_roll = 0.0;
+double smooth_pitch = 0.0;
+uint8_t smooth_primed = 0;
+TiltEstimator tilt;
+AttackTracker attack;
+uint8_t attack_velocity = ATTACK_MIN_VELOCITY; // velocity of the sounding note
+GyroFusion gyro_fusion;
+ClockSync clock_sync;
+TraceWriter trace;
+TempCompensator temp_comp;
+GlideRamp glide;
+#if UMP_OUTPUT
+UmpBuffer ump;
+uint8_t ump_note = 0; // sounding note, 0 for none
+uint32_t ump_expression = 0;
+uint32_t ump_bend = UMP_BEND_CENTER;
+#endif
+#if OVERSAMPLE_RATIO > 1
+CicDecimator<OVERSAMPLE_RATIO, OVERSAMPLE_STAGES> accel_decimator;
+#endif
+uint32_t imu_report_ms = 0;
+uint32_t reported_period_us = 0;
+float last_volume = 0.0f;
+uint32_t heartbeat_seq = 0;
+
+// Streams the accelerometer, with temperature alongside only when there is
+// a table to use it with, for a mapping rate of rate_ms. The sensor takes
+// whole milliseconds and oversampling streams OVERSAMPLE_RATIO times faster,
+// so the rate actually used is the nearest multiple of OVERSAMPLE_RATIO ms;
+// that is what is returned.
+int applySensorRate(int rate_ms) {
+    int input_ms = (rate_ms + OVERSAMPLE_RATIO / 2) / OVERSAMPLE_RATIO;
+    if (input_ms < 1) {
+        input_ms = 1;
     }
-    
-    // Volume calculation logic remains the same
-    if (pitch < -30) {
-        midi_volume = 0;
-    } 
-    else if (pitch > 30) {
-        midi_volume = 127;
-    } 
-    else {
-  
-        midi_volume =  abs(pitch + 30) * 2.116;
+    setSensorSettings(1, params.temp_points > 0, input_ms, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0);
+    return input_ms * OVERSAMPLE_RATIO;
+}
+
+// The configured rate, and a line when oversampling moved it
+void applyConfiguredRate() {
+    int rate_ms = applySensorRate(params.sensor_rate_ms);
+    if (rate_ms != params.sensor_rate_ms) {
+        printInt("sensor rate %d ms\n", printOutColor::printColorBlack, printOutDataType::printUInt32, rate_ms);
+    }
+}
+
+// Live traces of the mapping on the left, the performer on the right. Picture
+// controls take their visibility as the control value.
+void setup_panels() {
+    addPanel(GUI_PANEL_MAIN, 1, 0, 0, 0, 0, 0, 0, 1);
+    addControlPlotData(PLOT_ROLL, 0xFF, 0x80, 0x00);
+    addControlPlotData(PLOT_PITCH, 0x00, 0xC0, 0xFF);
+    addControlPlotData(PLOT_VOLUME, 0x00, 0xFF, 0x40);
+    addControlPlotData(PLOT_NOTE, 0xFF, 0xFF, 0xFF);
+    addControlPlot(GUI_PANEL_MAIN, GUI_CONTROL_ANGLES, 1, (1 << PLOT_ROLL) | (1 << PLOT_PITCH), 0, 0, 210, 115, -90, 90, 0, 0, 0);
+    addControlPlot(GUI_PANEL_MAIN, GUI_CONTROL_OUTPUT, 1, (1 << PLOT_VOLUME) | (1 << PLOT_NOTE), 0, 120, 210, 115, 0, 127, 0, 0, 0);
+    addControlPictureFromFile(GUI_PANEL_MAIN, GUI_CONTROL_GUY_OPEN, 215, 70, "guy-open.fwi", 0);
+    addControlPictureFromFile(GUI_PANEL_MAIN, GUI_CONTROL_GUY_CLOSED, 215, 70, "guy-closed.fwi", 1);
+    showPanel(GUI_PANEL_MAIN);
+}
+
+// The mic streams in breath mode, the FFT while following a pitch and not
+// resting.
+void applyAudioSettings() {
+    setAudioSettings(play_mode == MODE_BREATH, pitch_follow && !stillness.idle, 0, 0, 0, 0);
+}
+
+// Events the firmware handed over that could not be decoded
+uint32_t unknown_events = 0;
+uint32_t event_overflows = 0; // the firmware's event queue or wasm buffer ran over
+uint32_t decode_reported = 0;
+uint32_t decode_report_ms = 0;
+
+void reportDecode() {
+    uint32_t average = sysex.broken ? sysex.lost_bytes / sysex.broken : 0;
+    printInt("decode %d broken, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(sysex.broken));
+    printInt("%d bytes lost, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(sysex.lost_bytes));
+    printInt("%d per break, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(average));
+    printInt("%d unknown events, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(unknown_events));
+    printInt("%d overflows\n", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(event_overflows));
+}
+
+// A full trace block is written from its own task, after the sample path
+// and anything else due in the same pass
+void traceRecord(uint32_t time_ms, uint8_t kind, uint8_t channel, int16_t a, int16_t b, int16_t c) {
+    if (trace.add(time_ms, kind, channel, a, b, c)) {
+        schedAt(TASK_TRACE, nowUs());
+    }
+}
+
+void traceTask(uint32_t) {
+    trace.write();
+}
+
+void heartbeatTask(uint32_t now_us) {
+    printInt("hb %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(heartbeat_seq++));
+    schedAt(TASK_HEARTBEAT, now_us + HEARTBEAT_MS * 1000u);
+
+    uint32_t errors = sysex.broken + unknown_events + event_overflows;
+    uint32_t now_ms = millis();
+    if (errors != decode_reported && now_ms - decode_report_ms >= DECODE_REPORT_MS) {
+        decode_reported = errors;
+        decode_report_ms = now_ms;
+        reportDecode();
+    }
+}
+
+void reportImuLoad() {
+    printInt("imu %d reads, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(gyro_fusion.reads));
+    printInt("%d us each, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(gyro_fusion.read_us));
+    printInt("%d failed\n", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(gyro_fusion.failures));
+    gyro_fusion.reads = 0;
+    gyro_fusion.failures = 0;
+}
+
+// Gyro samples run off their own deadline. While resting the IMU is left
+// alone, and the fused angles restart from the accelerometer on waking.
+void imuTask(uint32_t now_us) {
+    if (stillness.idle) {
+        gyro_fusion.primed = 0;
+        gyro_fusion.last_us = now_us;
+        schedAt(TASK_IMU, now_us + STILL_SLEEP_MS * 1000u);
+        return;
+    }
+    if (gyro_fusion.integrate(now_us)) {
+        traceRecord(millis(), TRACE_GYRO, 0, static_cast<int16_t>(gyro_fusion.last_rate[0]), static_cast<int16_t>(gyro_fusion.last_rate[1]),
+                    static_cast<int16_t>(gyro_fusion.last_rate[2]));
+    }
+    schedAt(TASK_IMU, now_us + IMU_PERIOD_US);
+
+    uint32_t now_ms = millis();
+    if (now_ms - imu_report_ms >= IMU_REPORT_MS) {
+        imu_report_ms = now_ms;
+        reportImuLoad();
+    }
+}
+
+// The leader's beacon carries the deadline it was due at, not when the loop
+// got to it, so a late pass does not show up as jitter on every follower.
+void syncTask(uint32_t now_us) {
+    uint32_t due_us = clock_sync.next_beacon_us;
+    uint8_t packet[SYNC_BEACON_BYTES];
+    clock_sync.track(due_us);
+    syncBeacon(packet, clock_sync.seq++, clock_sync.shared_ref);
+    if (RadioWrite(SYNC_RADIO, packet, SYNC_BEACON_BYTES)) {
+        clock_sync.beacons++;
+    }
+    clock_sync.next_beacon_us = due_us + SYNC_BEACON_MS * 1000u;
+    if (timeReached(now_us, clock_sync.next_beacon_us)) {
+        clock_sync.next_beacon_us = now_us + SYNC_BEACON_MS * 1000u;
+    }
+    schedAt(TASK_SYNC, clock_sync.next_beacon_us);
+}
+
+void reportSync() {
+    if (!clock_sync.locked) {
+        printInt("sync lost\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        return;
+    }
+    printInt("sync locked, error %d us, ", printOutColor::printColorBlack, printOutDataType::printInt32, static_cast<int>(clock_sync.last_error_us));
+    printInt("drift %d ppm\n", printOutColor::printColorBlack, printOutDataType::printInt32, static_cast<int>(clock_sync.drift_q4 / 16));
+}
+
+// Followers pick beacons up once per loop pass. While resting the loop
+// sleeps too long for the pickup time to mean anything, so beacons are only
+// drained; nothing is played then anyway.
+void pollRadio() {
+    if (clock_sync.role != SYNC_FOLLOWER) {
+        return;
+    }
+    uint8_t was_locked = clock_sync.locked;
+    uint32_t now_ms = millis();
+    int count = RadioGetRxCount(SYNC_RADIO);
+    if (count > 0) {
+        uint8_t rx[SYNC_BEACON_BYTES * 2];
+        if (count > static_cast<int>(sizeof(rx))) {
+            count = sizeof(rx);
+        }
+        count = RadioRead(SYNC_RADIO, rx, count);
+        for (int i = 0; i < count; i++) {
+            uint32_t shared_us;
+            if (clock_sync.feed(rx[i], shared_us)) {
+                clock_sync.last_rx_ms = now_ms;
+                if (!stillness.idle) {
+                    clock_sync.onBeacon(shared_us, now_ms * 1000u);
+                }
+            }
+        }
+    }
+    if (clock_sync.locked && now_ms - clock_sync.last_rx_ms > SYNC_LOST_MS) {
+        clock_sync.locked = 0;
+        clock_sync.good = 0;
+    }
+    if (clock_sync.locked != was_locked) {
+        reportSync();
+    }
+}
+
+void looperArm() {
+    if (looper.layer_count && !schedArmed(TASK_LOOP)) {
+        schedAt(TASK_LOOP, nowUs());
+    }
+}
+
+// Everything the host plays live goes through here, so the looper records
+// exactly what was heard.
+void emitNote(uint8_t note, float volume) {
+    last_note = note;
+    if (params.output_format == OUTPUT_INT) {
+        printInt("%d ", printOutColor::printColorBlack, printOutDataType::printUInt32, note);
+        printInt("%d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(volume));
+    } else {
+        printFloat("%.1f ", printOutColor::printColorBlack, static_cast<float>(note));
+        printFloat("%.1f\n", printOutColor::printColorBlack, volume);
+    }
+    looper.record(millis(), note, static_cast<uint8_t>(volume));
+    looperArm();
+    traceRecord(millis(), TRACE_NOTE, 0, note, static_cast<int16_t>(volume), 0);
+}
+
+// Pitch bend on the live channel: "pb <0..16383>", 8192 is the center
+void emitBend(int16_t bend) {
+    glide.sent = bend;
+    printInt("pb %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, bend + GLIDE_BEND_CENTER);
+    traceRecord(millis(), TRACE_BEND, 0, bend, 0, 0);
+}
+
+void sendBend() {
+#if UMP_OUTPUT
+    // Every tick of the ramp is a new value at 32 bits. The bend is in 14
+    // bit steps, Q16; times 4 spans the full range around the center.
+    uint32_t value = UMP_BEND_CENTER + static_cast<uint32_t>(glide.bend_q16 * 4);
+    if (value != ump_bend) {
+        ump_bend = value;
+        ump.pitchBend(MIDI_CHANNEL, value);
+    }
+#endif
+    if (glide.bend() != glide.sent) {
+        emitBend(glide.bend());
+    }
+}
+
+// Ticks follow the previous deadline like the arpeggiator steps, so a late
+// loop pass does not stretch the slide.
+void glideTask(uint32_t now_us) {
+    bool more = glide.tick();
+    sendBend();
+    if (more) {
+        glide.next_us += GLIDE_TICK_US;
+        if (timeReached(now_us, glide.next_us)) {
+            glide.next_us = now_us + GLIDE_TICK_US;
+        }
+        schedAt(TASK_GLIDE, glide.next_us);
+    }
+}
+
+// The note to sound for a new one from the mapping. A jump recenters the
+// bend before the note goes out.
+uint8_t glideTo(uint8_t note) {
+    uint8_t sounding = glide.retarget(note, params.glide_ms);
+    if (!glide.ramping()) {
+        schedCancel(TASK_GLIDE);
+        sendBend();
+    } else if (!schedArmed(TASK_GLIDE)) {
+        glide.next_us = nowUs() + GLIDE_TICK_US;
+        schedAt(TASK_GLIDE, glide.next_us);
+    }
+    return sounding;
+}
+
+// Anything that plays notes without going through glideTo starts centered
+void glideReset() {
+    schedCancel(TASK_GLIDE);
+    glide.primed = 0;
+    glide.ticks = 0;
+    glide.bend_q16 = 0;
+    sendBend();
+}
+
+// Controller change on the live channel: "cc <controller> <value>"
+void emitControl(uint8_t controller, uint8_t value) {
+    printInt("cc %d ", printOutColor::printColorBlack, printOutDataType::printUInt32, controller);
+    printInt("%d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, value);
+    traceRecord(millis(), TRACE_CC, 0, controller, value, 0);
+}
+
+void sendExpression(uint8_t value) {
+    if (value != sent_expression) {
+        sent_expression = value;
+        emitControl(EXPRESSION_CC, value);
+    }
+}
+
+// Looper layers play on their own voices: "v <voice> <note> <volume>"
+void emitLoopVoice(uint8_t voice, uint8_t note, uint8_t volume) {
+    printInt("v %d ", printOutColor::printColorBlack, printOutDataType::printUInt32, voice);
+    printInt("%d ", printOutColor::printColorBlack, printOutDataType::printUInt32, note);
+    printInt("%d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, volume);
+    traceRecord(millis(), TRACE_NOTE, static_cast<uint8_t>(voice + 1), note, volume, 0);
+}
+
+void loopTask(uint32_t) {
+    if (!looper.layer_count) {
+        return;
+    }
+    // Events are recorded against millis(), so play them back on the same
+    // clock; nowUs() wraps long before millis() does.
+    uint32_t now_ms = millis();
+    uint32_t next_ms = looper.service(now_ms, emitLoopVoice);
+    schedAt(TASK_LOOP, nowUs() + (next_ms - now_ms) * 1000u);
+}
+
+void looperClear() {
+    looper.clear();
+    schedCancel(TASK_LOOP);
+    printInt("loop clear\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+}
+
+// Yellow button: record, then overdub a layer per press. A double press clears.
+void looperButton() {
+    uint32_t now_ms = millis();
+    if (looper_press_ms && now_ms - looper_press_ms < LOOP_DOUBLE_PRESS_MS) {
+        looper_press_ms = 0;
+        looperClear();
+        return;
+    }
+    looper_press_ms = now_ms;
+
+    if (looper.state == LOOP_RECORDING || looper.state == LOOP_OVERDUB) {
+        looper.end(now_ms);
+        looperArm();
+    } else if (!looper.begin(now_ms, last_note, static_cast<uint8_t>(last_volume))) {
+        printInt("loop full\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        return;
+    }
+    printInt("loop %d ", printOutColor::printColorBlack, printOutDataType::printUInt32, looper.state);
+    printInt("%d bytes\n", printOutColor::printColorBlack, printOutDataType::printUInt32, looper.used);
+}
+
+bool transportRunning(uint32_t now_us) {
+    return ext_clock.active(now_us) || midi_clock.running;
+}
+
+// Release a held note as soon as a clock tick lands on the grid, rather than
+// waiting for the next sensor sample.
+void quantizeTick(uint32_t tick_index) {
+    if (quantizer.onTick(tick_index)) {
+        uint8_t note = glideTo(quantizer.emitted_note);
+#if ATTACK_VELOCITY
+        if (note != last_note) {
+            attack_velocity = quantizer.emitted_velocity;
+        }
+        emitNote(note, attack_velocity);
+#else
+        emitNote(note, last_volume);
+#endif
     }
+}
 
-    setBoardLED(ind, 0x30, 0x30, 0x30, 100, LEDManagerLEDMode::ledpulsefade); 
-    printFloat("%.1f ", printOutColor::printColorBlack, static_cast<float>(midi_note));
-    printFloat("%.1f\n", printOutColor::printColorBlack, static_cast<float>(midi_volume));
+#if UMP_OUTPUT
+// The whole batch in one write
+void umpUartSink(const uint32_t *words, int count) {
+    static uint8_t bytes[UMP_BUFFER_WORDS * 4];
+    for (int i = 0; i < count; i++) {
+        bytes[i * 4] = static_cast<uint8_t>(words[i] >> 24);
+        bytes[i * 4 + 1] = static_cast<uint8_t>(words[i] >> 16);
+        bytes[i * 4 + 2] = static_cast<uint8_t>(words[i] >> 8);
+        bytes[i * 4 + 3] = static_cast<uint8_t>(words[i]);
+    }
+    UARTDataWrite(bytes, count * 4);
+}
 
+void umpRelease() {
+    if (ump_note) {
+        ump.noteOff(MIDI_CHANNEL, ump_note);
+        ump_note = 0;
+    }
+}
+#endif
+
+// Clock ticks do not wait for the end of the loop pass
+void sendRealtime(uint8_t status) {
+#if UMP_OUTPUT
+    ump.realtime(status);
+    ump.flush();
+#elif CLOCK_OUT_UART
+    UARTDataWrite(&status, 1);
+#else
+    (void)status;
+#endif
+}
+
+void reportTempo() {
+    reported_period_us = tempo_pll.period_us;
+    printFloat("tempo %.1f\n", printOutColor::printColorBlack, MidiClock::bpm(tempo_pll));
+}
+
+void clockTask(uint32_t now_us) {
+    // An external clock is the master, the beat tracker must not compete with
+    // it. Gear following our clock is told to stop rather than left running.
+    if (ext_clock.active(now_us)) {
+        if (midi_clock.running) {
+            midi_clock.running = 0;
+            sendRealtime(MIDI_STOP);
+            printInt("stop\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        }
+        tempo_pll.reset();
+        return;
+    }
+
+    uint8_t status = midi_clock.service(now_us, tempo_pll);
+    if (status) {
+        sendRealtime(status);
+    }
+
+    if (status == MIDI_START) {
+        printInt("start\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        reportTempo();
+    } else if (status == MIDI_STOP) {
+        printInt("stop\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+    } else if (status == MIDI_CLOCK) {
+        quantizeTick(midi_clock.ticks - 1);
+    }
+
+    if (status == MIDI_CLOCK && midi_clock.tick == 0) {
+        // A beat just finished, report the tempo if it moved more than 0.5%
+        uint32_t diff = tempo_pll.period_us > reported_period_us ? tempo_pll.period_us - reported_period_us
+                                                                 : reported_period_us - tempo_pll.period_us;
+        if (diff > reported_period_us / 200) {
+            reportTempo();
+        }
+    }
+
+    // A stopped clock sleeps until trackBeat() sees the PLL lock again
+    if (midi_clock.running) {
+        schedAt(TASK_CLOCK, midi_clock.nextDue(now_us, tempo_pll));
+    }
+}
+
+// Arpeggiator steps run off their own deadlines; each deadline is the previous
+// one plus the interval, so steps do not drift with loop timing.
+void arpTask(uint32_t now_us) {
+    uint8_t note = arp.nextNote(static_cast<uint32_t>(wilirand()));
+    emitNote(note, last_volume);
+
+    arp.next_us += arp.interval_us;
+    if (timeReached(now_us, arp.next_us)) {
+        arp.next_us = now_us + arp.interval_us; // fell behind, skip rather than burst
+    }
+    // Playing together, steps land on multiples of the interval in shared
+    // time. Looking from half a step ahead keeps a step that just fired
+    // from being picked again.
+    if (clock_sync.synced()) {
+        arp.next_us = clock_sync.nextGrid(now_us + arp.interval_us / 2, arp.interval_us);
+    }
+    schedAt(TASK_ARP, arp.next_us);
+}
+
+void setArpPattern(uint8_t pattern) {
+    arp.pattern = pattern;
+    arp.step = 0;
+    printInt("pattern %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, pattern);
+}
+
+void setPlayMode(uint8_t mode) {
+    play_mode = mode;
+    glideReset();
+#if UMP_OUTPUT
+    umpRelease();
+#endif
+    if (mode == MODE_ARP) {
+        arp.step = 0;
+        arp.tapped = 0;
+        arp.next_us = nowUs();
+        schedAt(TASK_ARP, arp.next_us);
+    } else {
+        schedCancel(TASK_ARP);
+    }
+    applyAudioSettings();
+    printInt("mode %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, mode);
+}
+
+// One complete SysEx message from the host. Commands only edit the staged
+// copy; commit hands it to the sample path in one piece.
+void hostCommand() {
+    if (sysex.length < 2 || sysex.body[0] != SYSEX_MANUFACTURER) {
+        return;
+    }
+    if (sysex.body[1] == CMD_COMMIT) {
+        committed_params = staged_params;
+        committed_groups |= staged_groups;
+        staged_groups = 0;
+        return;
+    }
+    if (sysex.body[1] == CMD_RESET) {
+        staged_params = params;
+        staged_groups = 0;
+        return;
+    }
+    if (sysex.body[1] == CMD_PATTERN) {
+        if (sysex.length == 3 && sysex.body[2] < ARP_PATTERN_COUNT) {
+            setArpPattern(sysex.body[2]);
+        } else {
+            printInt("cmd error %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, CMD_PATTERN);
+        }
+        return;
+    }
+    int group = stageCommand(staged_params, sysex.body, sysex.length);
+    if (group < 0) {
+        printInt("cmd error %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, sysex.body[1]);
+        return;
+    }
+    staged_groups = static_cast<uint8_t>(staged_groups | group);
+}
+
+// Incoming MIDI on the UART. Clock and transport messages drive the
+// external clock, the rest of the realtime range (active sensing, reset,
+// undefined) is dropped wherever it lands, even inside a SysEx message, and
+// everything else goes to the SysEx parser.
+void midiInByte(uint8_t byte, uint32_t now_us) {
+    switch (byte) {
+    case MIDI_CLOCK:
+        if (ext_clock.tick(now_us)) {
+            quantizeTick(ext_clock.ticks - 1);
+        }
+        break;
+    case MIDI_START:
+        ext_clock.start();
+        break;
+    case MIDI_CONTINUE:
+        ext_clock.resume();
+        break;
+    case MIDI_STOP:
+        ext_clock.stop();
+        break;
+    default:
+        if (byte < MIDI_CLOCK && sysex.feed(byte)) {
+            hostCommand();
+        }
+        break;
+    }
+}
+
+// Parse whatever the UART has buffered without ever waiting for more.
+void pollUart() {
+    int count = UARTDataRxCount();
+    if (count <= 0) {
+        return;
+    }
+    if (count > UART_READ_MAX) {
+        count = UART_READ_MAX;
+    }
+
+    uint8_t rx[UART_READ_MAX];
+    if (!UARTDataRead(rx, count)) {
+        return;
+    }
+    uint32_t now_us = nowUs();
+    for (int i = 0; i < count; i++) {
+        midiInByte(rx[i], now_us);
+    }
+}
+
+void trackBeat() {
+    uint32_t beat_ms;
+    if (beat_detector.update(sample_ring, beat_ms)) {
+        tempo_pll.ictus(beat_ms * 1000u);
+        if (tempo_pll.locked && !midi_clock.running && !schedArmed(TASK_CLOCK)) {
+            schedAt(TASK_CLOCK, nowUs());
+        }
+    }
+}
+
+void wakeUp() {
+    applySensorRate(params.sensor_rate_ms);
+    applyAudioSettings();
+    printInt("active\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+}
+
+// The hand has been resting: stream slowly, stop drawing and sending, sleep
+// longer. Playback that is already scheduled carries on.
+void updateStillness() {
+    int change = stillness.update(sample_ring);
+    if (change == STILL_ENTERED_IDLE) {
+        applySensorRate(STILL_SENSOR_RATE_MS);
+        applyAudioSettings();
+        printInt("idle\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+    } else if (change == STILL_WOKE) {
+        wakeUp();
+    }
+}
+
+void reportAudioLoad() {
+    printInt("audio %d events, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(audio_load.events));
+    printInt("%d blocks, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(audio_load.blocks));
+    printInt("%d max per pass, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(audio_load.max_batch));
+    printInt("%d passes capped\n", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(audio_load.capped));
+    audio_load = AudioLoad();
+}
+
+// One mic event. Most calls only accumulate; once a block is complete the
+// envelope becomes the volume and the expression controller.
+void processAudioData(uint8_t *event_data) {
+    audio_load.events++;
+    if (!breath.addEvent(event_data)) {
+        return;
+    }
+    audio_load.blocks++;
+
+    // Blowing while holding still is still playing
+    if (breath.volume) {
+        stillness.quiet = 0;
+        if (stillness.idle) {
+            stillness.idle = 0;
+            wakeUp();
+        }
+    }
+
+    sendExpression(breath.volume);
+
+    uint32_t now_ms = millis();
+    if (now_ms - audio_report_ms >= AUDIO_REPORT_MS) {
+        audio_report_ms = now_ms;
+        reportAudioLoad();
+    }
+}
+
+// Whether the root shifted by this many octaves keeps every note the zones
+// and the arpeggio chords on them reach (a fifth above the top zone) in MIDI
+// range for the current scale.
+bool octaveFits(int shift) {
+    int root = root_base + 12 * shift;
+    ScaleQuantizer reach = {scale_quantizer.scale, 0};
+    return root >= 0 && root + reach.note(ZONE_COUNT - 1 + 4) <= 127;
+}
+
+// A new root or scale can leave the octave shift out of range, so it is
+// pulled back towards 0 until everything fits.
+void applyScaleRoot() {
+    while (octave_shift > 0 && !octaveFits(octave_shift)) {
+        octave_shift--;
+    }
+    while (octave_shift < 0 && !octaveFits(octave_shift)) {
+        octave_shift++;
+    }
+    scale_quantizer.root = static_cast<uint8_t>(root_base + 12 * octave_shift);
+    arp.build(arp.degree, scale_quantizer);
+    printInt("root %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, scale_quantizer.root);
+}
+
+// One slice of an FFT frame. A stable hummed note moves the scale root to
+// its pitch class, kept within half an octave of MIDI_NOTE so the roll zones
+// stay in the same register.
+void processFftData(uint8_t *event_data) {
+    int note = pitch_follower.addEvent(event_data);
+    if (note < 0) {
+        return;
+    }
+    int pitch_class = note % 12;
+    uint8_t root = static_cast<uint8_t>(MIDI_NOTE + pitch_class - (pitch_class > 6 ? 12 : 0));
+    if (root == root_base) {
+        return;
+    }
+    root_base = root;
+    applyScaleRoot();
+}
+
+// Turning following off goes back to the configured root
+void setPitchFollow(uint8_t on) {
+    pitch_follow = on;
+    if (!on && root_base != params.root) {
+        root_base = params.root;
+        applyScaleRoot();
+    }
+    applyAudioSettings();
+    printInt("follow %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, on);
+}
+
+void remoteLearned() {
+    gray_press_ms = 0;
+    int saved = remote.save();
+    printInt("ir learned, saved %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, saved);
+}
+
+// Gray cycles the quantize grid; a quick second press undoes that and starts
+// learning the IR remote instead.
+void grayButton() {
+    uint32_t now_ms = millis();
+    if (gray_press_ms && now_ms - gray_press_ms < LEARN_DOUBLE_PRESS_MS && !remote_learner.active) {
+        gray_press_ms = 0;
+        quantizer.grid = gray_prev_grid;
+        remote_learner.start(remote);
+        printInt(REMOTE_PROMPTS[0], printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        return;
+    }
+    gray_press_ms = now_ms;
+
+    // While learning, gray skips the key being asked for
+    if (remote_learner.active) {
+        if (remote_learner.next()) {
+            remoteLearned();
+        } else {
+            printInt(REMOTE_PROMPTS[remote_learner.action], printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        }
+        return;
+    }
+
+    gray_prev_grid = quantizer.grid;
+    quantizer.cycle();
+    printInt("quantize %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, quantizer.grid);
+}
+
+void processIrCode(uint8_t *event_data) {
+    uint32_t code = static_cast<uint32_t>(event_data[0]) | static_cast<uint32_t>(event_data[1]) << 8 |
+                    static_cast<uint32_t>(event_data[2]) << 16 | static_cast<uint32_t>(event_data[3]) << 24;
+    if (code == 0) {
+        return;
+    }
+
+    if (remote_learner.active) {
+        if (remote_learner.learn(remote, code)) {
+            remoteLearned();
+        } else if (remote_learner.active) {
+            printInt(REMOTE_PROMPTS[remote_learner.action], printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        }
+        return;
+    }
+
+    switch (remote.find(code)) {
+    case REMOTE_MODE:
+        setPlayMode(static_cast<uint8_t>((play_mode + 1) % MODE_COUNT));
+        break;
+    case REMOTE_SCALE:
+        scale_quantizer.scale = static_cast<uint8_t>((scale_quantizer.scale + 1) % SCALE_COUNT);
+        printInt("scale %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, scale_quantizer.scale);
+        applyScaleRoot();
+        break;
+    case REMOTE_OCTAVE_UP:
+        if (octave_shift < OCTAVE_SHIFT_MAX && octaveFits(octave_shift + 1)) {
+            octave_shift++;
+            applyScaleRoot();
+        }
+        break;
+    case REMOTE_OCTAVE_DOWN:
+        if (octave_shift > -OCTAVE_SHIFT_MAX && octaveFits(octave_shift - 1)) {
+            octave_shift--;
+            applyScaleRoot();
+        }
+        break;
+    case REMOTE_RECORD:
+        looperButton();
+        break;
+    case REMOTE_FOLLOW:
+        setPitchFollow(!pitch_follow);
+        break;
+    case REMOTE_PATTERN:
+        setArpPattern(static_cast<uint8_t>((arp.pattern + 1) % ARP_PATTERN_COUNT));
+        break;
+    default:
+        break; // not a learned key
+    }
+}
+
+// Sleep until the next scheduler deadline, at most 1 ms while playing and
+// STILL_SLEEP_MS while resting.
+int loopSleepMs() {
+    int sleep_ms = stillness.idle ? STILL_SLEEP_MS : 1;
+    uint32_t due_us;
+    if (schedNextDue(due_us)) {
+        int32_t left_ms = static_cast<int32_t>(due_us - nowUs()) / 1000;
+        if (left_ms < sleep_ms) {
+            sleep_ms = left_ms < 1 ? 1 : static_cast<int>(left_ms);
+        }
+    }
+    return sleep_ms;
+}
+
+// Swap in what the host committed, between two samples.
+void applyParams() {
+    params = committed_params;
+    if (committed_groups & PARAM_SCALE) {
+        scale_quantizer.scale = params.scale;
+        root_base = params.root;
+        applyScaleRoot();
+    }
+    if ((committed_groups & PARAM_RATE) && !stillness.idle) {
+        applyConfiguredRate();
+    }
+    if (committed_groups & PARAM_FILTER) {
+        smooth_primed = 0;
+    }
+    if (committed_groups & PARAM_VOLUME) {
+        buildVolumeTable(params, volume_table);
+    }
+    printInt("params %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, committed_groups);
+    committed_groups = 0;
+}
+
+// Recompute the temperature offsets if it has moved far enough since the last time.
+void compensateTemperature(uint32_t now_ms, const uint8_t *event_data) {
+    int16_t reading = static_cast<int16_t>(event_data[TEMP_EVENT_OFFSET] | event_data[TEMP_EVENT_OFFSET + 1] << 8);
+    int16_t temp_x10 = static_cast<int16_t>(reading / TEMP_EVENT_PER_X10);
+    traceRecord(now_ms, TRACE_TEMP, 0, reading, 0, 0);
+    if (temp_comp.update(now_ms, temp_x10, params.temp_table, params.temp_points)) {
+        printFloat("temp %.1f C, offsets ", printOutColor::printColorBlack, temp_x10 / 10.0f);
+        printInt("%d ", printOutColor::printColorBlack, printOutDataType::printInt32, temp_comp.offset[0]);
+        printInt("%d ", printOutColor::printColorBlack, printOutDataType::printInt32, temp_comp.offset[1]);
+        printInt("%d\n", printOutColor::printColorBlack, printOutDataType::printInt32, temp_comp.offset[2]);
+    }
+}
+
+// Sample path stages that work on the firmware state. The pipelines for each
+// play mode are put together from these below.
+
+// Raw counts in, after any committed parameters have been swapped in. Also
+// feeds the history the beat and stillness detectors work on, and drops the
+// sample while resting.
+struct DecodeAccel {
+    static inline bool apply(const uint8_t *event_data, SampleFrame &frame) {
+        if (committed_groups) {
+            applyParams();
+        }
+        int16_t x = static_cast<int16_t>(event_data[0] | event_data[1] << 8);
+        int16_t y = static_cast<int16_t>(event_data[2] | event_data[3] << 8);
+        int16_t z = static_cast<int16_t>(event_data[4] | event_data[5] << 8);
+        uint32_t now_ms = millis();
+        // The reading goes in the trace ahead of the sample it came with
+        if (params.temp_points && temp_comp.due(now_ms)) {
+            compensateTemperature(now_ms, event_data);
+        }
+        traceRecord(now_ms, TRACE_SAMPLE, 0, x, y, z);
+        frame.x = static_cast<int16_t>(x - params.accel_offset[0] - temp_comp.offset[0]);
+        frame.y = static_cast<int16_t>(y - params.accel_offset[1] - temp_comp.offset[1]);
+        frame.z = static_cast<int16_t>(z - params.accel_offset[2] - temp_comp.offset[2]);
+#if OVERSAMPLE_RATIO > 1
+        // Everything after this runs at the output rate
+        if (!accel_decimator.add(frame.x, frame.y, frame.z)) {
+            return false;
+        }
+        frame.x = accel_decimator.out[0];
+        frame.y = accel_decimator.out[1];
+        frame.z = accel_decimator.out[2];
+#endif
+
+        sample_ring.push(now_ms, frame.x, frame.y, frame.z);
+        updateStillness();
+        if (stillness.idle) {
+            return false;
+        }
+        trackBeat();
+        return true;
+    }
+};
+
+// Replace the sample with the gravity estimate, so a quick arm movement does
+// not swing the tilt and play wrong notes
+struct RejectMotion {
+    static inline bool apply(SampleFrame &frame) {
+        tilt.update(frame.x, frame.y, frame.z);
+        frame.x = static_cast<int16_t>(tilt.gx);
+        frame.y = static_cast<int16_t>(tilt.gy);
+        frame.z = static_cast<int16_t>(tilt.gz);
+        return true;
+    }
+};
+
+// Pull the gyro's angles towards the accelerometer's and use them instead
+struct FuseGyro {
+    static inline bool apply(SampleFrame &frame) {
+        if (gyro_fusion.present) {
+            gyro_fusion.fuse(frame.roll, frame.pitch);
+        }
+        return true;
+    }
+};
+
+#if MOTION_REJECTION
+typedef Chain<RejectMotion, OrientGravity> OrientAccel;
+#else
+typedef OrientGravity OrientAccel;
+#endif
+
+#if EXTERNAL_IMU
+typedef Chain<OrientAccel, FuseGyro> Orient;
+#else
+typedef OrientAccel Orient;
+#endif
+
+// Attack speed comes from the motion-rejected angles, before smoothing
+// slows the hand down
+struct TrackAttack {
+    static inline bool apply(SampleFrame &frame) {
+        attack.update(sample_ring.back(0).t_ms, frame.roll, frame.pitch);
+        return true;
+    }
+};
+
+struct SmoothAngles {
+    static inline bool apply(SampleFrame &frame) {
+        if (!smooth_primed || params.smoothing_q8 == SMOOTHING_OFF_Q8) {
+            smooth_roll = frame.roll;
+            smooth_pitch = frame.pitch;
+            smooth_primed = 1;
+        } else {
+            smooth_roll += (frame.roll - smooth_roll) * params.smoothing_q8 / 256.0;
+            smooth_pitch += (frame.pitch - smooth_pitch) * params.smoothing_q8 / 256.0;
+        }
+        frame.roll = smooth_roll;
+        frame.pitch = smooth_pitch;
+        return true;
+    }
+};
+
+#if ANGLE_SMOOTHING
+typedef SmoothAngles AngleFilter;
+#else
+typedef NoFilter AngleFilter;
+#endif
+
+// Roll picks the scale degree
+struct ScaleZones {
+    static inline bool apply(SampleFrame &frame) {
+        frame.zone = rollZone(frame.roll, params.zone_edges);
+        frame.note = scale_quantizer.note(frame.zone);
+        return true;
+    }
+};
+
+struct PitchVolume {
+    static inline bool apply(SampleFrame &frame) {
+        frame.volume = pitchVolume(frame.pitch, volume_table);
+        return true;
+    }
+};
+
+struct BreathVolume {
+    static inline bool apply(SampleFrame &frame) {
+        frame.volume = breath.volume;
+        return true;
+    }
+};
+
+// LEDs 0-6 show the zone (the top zone wraps to 0), the display traces the
+// mapping. LEDs and pictures only change on a state change, a held note
+// costs nothing.
+struct ShowSample {
+    static inline bool apply(SampleFrame &frame) {
+        int ind = frame.zone % 7;
+        if (ind != lit_led) {
+            if (lit_led >= 0) {
+                setBoardLED(lit_led, 0, 0, 0, 0, LEDManagerLEDMode::ledsimplevalue);
+            }
+            setBoardLED(ind, 0x30, 0x30, 0x30, 0, LEDManagerLEDMode::ledsimplevalue);
+            lit_led = static_cast<int8_t>(ind);
+        }
+        last_volume = frame.volume;
+
+        int32_t trace[PLOT_CHANNELS] = {static_cast<int32_t>(frame.roll), static_cast<int32_t>(frame.pitch),
+                                        static_cast<int32_t>(frame.volume), last_note};
+        plotter.add(millis(), trace);
+        if (mouth.update(millis(), static_cast<int>(frame.volume))) {
+            setControlValue(GUI_PANEL_MAIN, GUI_CONTROL_GUY_OPEN, mouth.open);
+            setControlValue(GUI_PANEL_MAIN, GUI_CONTROL_GUY_CLOSED, !mouth.open);
+        }
+        return true;
+    }
+};
+
+struct PlayNote {
+    static inline bool apply(SampleFrame &frame) {
+        uint8_t velocity = static_cast<uint8_t>(frame.volume);
+        uint8_t note = glideTo(quantizer.request(frame.note, velocity, transportRunning(nowUs())));
+        emitNote(note, frame.volume);
+        return true;
+    }
+};
+
+// The note keeps the velocity it started with, set by the peak angular speed
+// just before it was asked for (held with it while quantizing); the volume
+// carries on as expression.
+struct PlayNoteAttack {
+    static inline bool apply(SampleFrame &frame) {
+        uint8_t note = glideTo(quantizer.request(frame.note, attack.velocity(), transportRunning(nowUs())));
+        if (note != last_note) {
+            attack_velocity = quantizer.emitted_velocity;
+        }
+        sendExpression(static_cast<uint8_t>(frame.volume));
+        emitNote(note, attack_velocity);
+        return true;
+    }
+};
+
+#if ATTACK_VELOCITY
+typedef PlayNoteAttack LiveNote;
+#else
+typedef PlayNote LiveNote;
+#endif
+
+#if UMP_OUTPUT
+// Follows what the live sink decided to play: the note with its velocity
+// and exact pitch, and the volume as 32 bit expression interpolated from
+// the pitch angle rather than read off the 7 bit table.
+struct PlayUmp {
+    static inline bool apply(SampleFrame &frame) {
+        double volume = play_mode == MODE_BREATH ? frame.volume / 127.0 : pitchVolumeFine(frame.pitch, volume_table);
+        if (last_note != ump_note) {
+            umpRelease();
+#if ATTACK_VELOCITY
+            uint16_t velocity = umpScale7to16(attack_velocity);
+#else
+            uint16_t velocity = static_cast<uint16_t>(umpUnit32(volume) >> 16);
+#endif
+            ump.noteOn(MIDI_CHANNEL, last_note, velocity, static_cast<uint16_t>(last_note << 9));
+            ump_note = last_note;
+        }
+        uint32_t expression = umpUnit32(volume);
+        if (expression != ump_expression) {
+            ump_expression = expression;
+            ump.control(MIDI_CHANNEL, EXPRESSION_CC, expression);
+        }
+        return true;
+    }
+};
+
+typedef Chain<LiveNote, PlayUmp> NoteSink;
+#else
+typedef LiveNote NoteSink;
+#endif
+
+// The arpeggiator task plays the notes, this only steers it
+struct SteerArp {
+    static inline bool apply(SampleFrame &frame) {
+        arp.setRoot(frame.zone, scale_quantizer);
+        arp.setRateFromPitch(frame.pitch, sample_ring.back(0).t_ms);
+        if (!arp.tapped) {
+            last_volume = ARP_VELOCITY;
+        }
+        return true;
+    }
+};
+
+#if ATTACK_VELOCITY
+typedef Chain<Orient, TrackAttack> OrientNote;
+#else
+typedef Orient OrientNote;
+#endif
+
+typedef Pipeline<DecodeAccel, OrientNote, AngleFilter, ScaleZones, PitchVolume, Chain<ShowSample, NoteSink>> ThereminPath;
+typedef Pipeline<DecodeAccel, Orient, AngleFilter, ScaleZones, PitchVolume, Chain<ShowSample, SteerArp>> ArpPath;
+typedef Pipeline<DecodeAccel, OrientNote, AngleFilter, ScaleZones, BreathVolume, Chain<ShowSample, NoteSink>> BreathPath;
+
+void processAccelData(uint8_t *event_data) {
+    switch (play_mode) {
+    case MODE_ARP:
+        ArpPath::run(event_data);
+        break;
+    case MODE_BREATH:
+        BreathPath::run(event_data);
+        break;
+    default:
+        ThereminPath::run(event_data);
+        break;
+    }
 }
 
 // not "proper" loop check the note holding functions to play notes out
@@ -118,33 +1242,181 @@ void loop() {
     uint8_t event_data[FW_GET_EVENT_DATA_MAX] = {0};
     int last_event;
 
-    // Check if there is an event, and if so, get the data from it
-    last_event = 0;
-    //note changer here?
-    if (hasEvent()) {
+    // Drain the queued events, running the scheduler between them so clock
+    // deadlines are not held up behind a burst of sensor data
+    int events = 0;
+    uint32_t audio_events = 0;
+    while (events < MAX_EVENTS_PER_LOOP && hasEvent()) {
         last_event = getEventData(event_data);
-    }
+        if (last_event < 0 || last_event >= FWGUI_EVENT_DATA_MAX) {
+            unknown_events++;
+            events++;
+            continue;
+        }
+        if (last_event == FWGUI_EVENT_EVENTFIFO_OVERFLOW || last_event == FWGUI_EVENT_WASM_OVRFLOW) {
+            event_overflows++;
+        }
+
+        // Mic and FFT data are batched without the per-event work below
+        if (last_event == FWGUI_EVENT_GUI_AUDIO_DATA) {
+            processAudioData(event_data);
+            if (++audio_events == AUDIO_EVENTS_PER_LOOP) {
+                audio_load.capped++;
+                break;
+            }
+            continue;
+        }
+        if (last_event == FWGUI_EVENT_GUI_FFT_DATA) {
+            processFftData(event_data);
+            if (++audio_events == AUDIO_EVENTS_PER_LOOP) {
+                audio_load.capped++;
+                break;
+            }
+            continue;
+        }
+        events++;
+        pollUart();
 
-    // If the event was SENSOR_DATA, process it
-    // note changer here?
-    if (last_event == FWGUI_EVENT_GUI_SENSOR_DATA) {
-        processAccelData(event_data);
+        // If the event was SENSOR_DATA, process it
+        if (last_event == FWGUI_EVENT_GUI_SENSOR_DATA) {
+            processAccelData(event_data);
+        }
+
+        // Exit condition: red button pressed
+        if (last_event == FWGUI_EVENT_RED_BUTTON) {
+            printInt("Exit...\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+            exitApp = 1;
+        }
+
+        if (last_event == FWGUI_EVENT_BLUE_BUTTON) {
+            setPlayMode(static_cast<uint8_t>((play_mode + 1) % MODE_COUNT));
+        }
+
+        if (last_event == FWGUI_EVENT_YELLOW_BUTTON) {
+            looperButton();
+        }
+
+        if (last_event == FWGUI_EVENT_GREEN_BUTTON) {
+            arp.tap(millis());
+        }
+
+        if (last_event == FWGUI_EVENT_GRAY_BUTTON) {
+            grayButton();
+        }
+
+        if (last_event == FWGUI_EVENT_IR_CODE) {
+            processIrCode(event_data);
+        }
+
+        schedRun(nowUs());
     }
+    if (audio_events > audio_load.max_batch) {
+        audio_load.max_batch = audio_events;
+    }
+    pollUart();
+    pollRadio();
+    schedRun(nowUs());
+#if UMP_OUTPUT
+    ump.flush();
+#endif
+}
 
-    // Exit condition: red button pressed
-    if (last_event == FWGUI_EVENT_RED_BUTTON) {
-        printInt("Exit...\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
-        exitApp = 1;
+void reportConfig() {
+    if (!config_report.found) {
+        printInt("no " CONFIG_FILE ", defaults\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+        return;
+    }
+    printInt("config %d lines, ", printOutColor::printColorBlack, printOutDataType::printUInt32, config_report.lines);
+    printInt("%d ignored, ", printOutColor::printColorBlack, printOutDataType::printUInt32, config_report.ignored);
+    printInt("%d ms, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(config_report.parse_ms));
+    printInt("%d bytes of tables\n", printOutColor::printColorBlack, printOutDataType::printUInt32,
+             static_cast<int>(sizeof(params) + sizeof(volume_table)));
+    if (config_report.rejected) {
+        printInt("config invalid, defaults\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
     }
 }
 
 int main() {
-    //setup_panels();
-    setSensorSettings(1, 0, 10, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0);
+    setup_panels();
+    params = defaultParams(MIDI_NOTE, SENSOR_RATE_MS);
+    loadConfig(params, config_report);
+    staged_params = params;
+    buildVolumeTable(params, volume_table);
+    scale_quantizer.scale = params.scale;
+    root_base = params.root;
+    scale_quantizer.root = root_base;
+    pitch_follow = params.pitch_follow;
+    plotter.interval_ms = params.plot_ms;
+    applyConfiguredRate();
+    applyAudioSettings();
     printInt("\nmain()\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+    reportConfig();
+    printInt("looper %d bytes, ", printOutColor::printColorBlack, printOutDataType::printUInt32, sizeof(looper));
+    printInt("%d bytes of the page free\n", printOutColor::printColorBlack, printOutDataType::printUInt32,
+             WASM_PAGE_BYTES - static_cast<int>(reinterpret_cast<uintptr_t>(&__heap_base)));
+    if (!remote.load()) {
+        printInt("ir remote not learned, double press gray\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+    }
+    schedInit(TASK_CLOCK, clockTask);
+    schedInit(TASK_ARP, arpTask);
+    schedInit(TASK_LOOP, loopTask);
+    schedInit(TASK_HEARTBEAT, heartbeatTask);
+    schedAt(TASK_HEARTBEAT, nowUs());
+    schedInit(TASK_GLIDE, glideTask);
+#if UMP_OUTPUT
+    ump.sink = umpUartSink;
+    ump.registeredControl(MIDI_CHANNEL, 0, 0, static_cast<uint32_t>(GLIDE_BEND_RANGE) << 25); // bend range
+#endif
+    if (params.glide_ms) {
+        printInt("bendrange %d\n", printOutColor::printColorBlack, printOutDataType::printUInt32, GLIDE_BEND_RANGE);
+    }
+    trace.handle = -1;
+    schedInit(TASK_TRACE, traceTask);
+    if (params.trace && !trace.open(millis())) {
+        printInt("could not open " TRACE_FILE "\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+    }
+    clock_sync.role = params.sync_role;
+    schedInit(TASK_SYNC, syncTask);
+    if (clock_sync.role == SYNC_LEADER) {
+        RadioSetTx(SYNC_RADIO);
+        clock_sync.next_beacon_us = nowUs();
+        clock_sync.shared_ref = clock_sync.next_beacon_us;
+        schedAt(TASK_SYNC, clock_sync.next_beacon_us);
+    } else if (clock_sync.role == SYNC_FOLLOWER) {
+        RadioSetRx(SYNC_RADIO);
+    }
+#if EXTERNAL_IMU
+    schedInit(TASK_IMU, imuTask);
+    if (gyro_fusion.probe(nowUs())) {
+        printInt("imu found, gyro bias %d, ", printOutColor::printColorBlack, printOutDataType::printInt32, static_cast<int>(gyro_fusion.bias[0]));
+        printInt("%d\n", printOutColor::printColorBlack, printOutDataType::printInt32, static_cast<int>(gyro_fusion.bias[1]));
+        imu_report_ms = millis();
+        traceRecord(millis(), TRACE_GYRO, 1, static_cast<int16_t>(gyro_fusion.bias[0]), static_cast<int16_t>(gyro_fusion.bias[1]),
+                    static_cast<int16_t>(gyro_fusion.bias[2]));
+        schedAt(TASK_IMU, nowUs());
+    } else {
+        printInt("no external imu\n", printOutColor::printColorBlack, printOutDataType::printUInt32, 0);
+    }
+#endif
+    arp.build(0, scale_quantizer);
+    arp.interval_us = ARP_SLOWEST_US;
     while (!exitApp) {
         loop();
-        waitms(1);  // Reduced wait time for more frequent updates, instead do the volume as a function to repaet
+        waitms(loopSleepMs());
+    }
+    if (midi_clock.running) {
+        sendRealtime(MIDI_STOP);
+    }
+#if UMP_OUTPUT
+    umpRelease();
+    ump.flush();
+    printInt("ump %d packets, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(ump.packets));
+    printInt("%d writes\n", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(ump.flushes));
+#endif
+    if (trace.handle >= 0) {
+        trace.close();
+        printInt("trace %d blocks, ", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(trace.blocks));
+        printInt("%d failed\n", printOutColor::printColorBlack, printOutDataType::printUInt32, static_cast<int>(trace.failures));
     }
     
     return 0;
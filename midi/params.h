@@ -0,0 +1,152 @@
+#pragma once
+#include <cmath>    // For pow, lround
+#include <stdint.h> // For int types
+#include "scale.h"
+#include "sync.h"
+#include "tempcomp.h"
+#include "glide.h"
+#include "gui.h"
+
+// Everything about the mapping that can be changed while playing. The live
+// copy is only read by the sample path; commands edit a staged copy that is
+// swapped in whole between two samples, so a sample never sees half of an
+// update.
+
+enum OutputFormat {
+    OUTPUT_FLOAT, // "60.0 127.0", what every host version understands
+    OUTPUT_INT,   // "60 127", cheaper to print and to send
+
+    OUTPUT_COUNT,
+};
+
+#define ROOT_MAX 96 // highest root; the widest scale and its chords reach 22 above it, still under 127
+#define SENSOR_RATE_MIN_MS 5
+#define SENSOR_RATE_MAX_MS 100
+#define SMOOTHING_OFF_Q8 256 // weight of the newest angle, 256 passes it unfiltered
+#define CURVE_LINEAR_X10 10  // volume curve exponent in tenths, 10 is a straight line
+#define CURVE_MAX_X10 50
+#define VOLUME_TABLE_SIZE 181 // one entry per degree of pitch, -90..90
+
+struct MappingParams {
+    uint8_t scale;                       // ScaleId
+    uint8_t root;                        // MIDI note of degree 0 before the octave shift
+    int16_t zone_edges[ZONE_COUNT - 1];  // tenths of a degree of roll, ascending
+    uint16_t smoothing_q8;               // one-pole weight on roll and pitch, 1..256
+    int16_t volume_min_deg;              // pitch giving volume 0
+    int16_t volume_max_deg;              // pitch giving volume 127
+    uint8_t volume_curve_x10;            // exponent of the pitch to volume curve
+    int16_t accel_offset[3];             // raw counts subtracted from x, y, z
+    uint8_t temp_points;                 // entries in temp_table, 0 turns compensation off
+    TempPoint temp_table[TEMP_POINTS_MAX]; // more offset by temperature
+    uint8_t sensor_rate_ms;
+    uint8_t output_format;               // OutputFormat
+    uint16_t glide_ms;                   // pitch bend slide between notes, 0 jumps
+    uint8_t sync_role;                   // SyncRole, only read at boot
+    uint8_t trace;                       // 1 records a trace file, only read at boot
+    uint8_t pitch_follow;                // 1 retunes the root from a hummed note, boot default
+    uint16_t plot_ms;                    // ms between display plot updates
+};
+
+// Groups a command touched, so applying an update only redoes what changed
+#define PARAM_SCALE 0x01
+#define PARAM_ZONES 0x02
+#define PARAM_FILTER 0x04
+#define PARAM_VOLUME 0x08
+#define PARAM_RATE 0x10
+#define PARAM_OUTPUT 0x20
+
+static inline MappingParams defaultParams(uint8_t root, uint8_t sensor_rate_ms) {
+    MappingParams params = {};
+    params.scale = SCALE_MAJOR;
+    params.root = root;
+    for (int i = 0; i < ZONE_COUNT - 1; i++) {
+        params.zone_edges[i] = static_cast<int16_t>((ZONE_MIN_DEG + ZONE_WIDTH_DEG * (i + 1)) * 10.0);
+    }
+    params.smoothing_q8 = SMOOTHING_OFF_Q8;
+    params.volume_min_deg = -30;
+    params.volume_max_deg = 30;
+    params.volume_curve_x10 = CURVE_LINEAR_X10;
+    params.sensor_rate_ms = sensor_rate_ms;
+    params.output_format = OUTPUT_FLOAT;
+    params.sync_role = SYNC_OFF;
+    params.trace = 0;
+    params.pitch_follow = 0; // any sound in the room, the synth included, would retune the root
+    params.plot_ms = PLOT_RATE_MS_DEFAULT;
+    return params;
+}
+
+// Precompute the volume for every whole degree of pitch, so the sample path
+// is one table lookup whatever the curve. Only rebuilt when the volume range
+// or curve changes.
+static inline void buildVolumeTable(const MappingParams &params, uint8_t *table) {
+    double span = params.volume_max_deg - params.volume_min_deg;
+    double exponent = params.volume_curve_x10 / 10.0;
+    for (int i = 0; i < VOLUME_TABLE_SIZE; i++) {
+        double t = (i - 90 - params.volume_min_deg) / span;
+        if (t <= 0.0) {
+            table[i] = 0;
+        } else if (t >= 1.0) {
+            table[i] = 127;
+        } else {
+            if (params.volume_curve_x10 != CURVE_LINEAR_X10) {
+                t = pow(t, exponent);
+            }
+            table[i] = static_cast<uint8_t>(lround(t * 127.0));
+        }
+    }
+}
+
+static inline uint8_t pitchVolume(double pitch, const uint8_t *table) {
+    long index = lround(pitch) + 90;
+    if (index < 0) {
+        index = 0;
+    } else if (index >= VOLUME_TABLE_SIZE) {
+        index = VOLUME_TABLE_SIZE - 1;
+    }
+    return table[index];
+}
+
+// The same curve between whole degrees, interpolated instead of rounded, on
+// a 0..1 scale for outputs finer than 7 bits
+static inline double pitchVolumeFine(double pitch, const uint8_t *table) {
+    double position = pitch + 90.0;
+    if (position <= 0.0) {
+        return table[0] / 127.0;
+    }
+    if (position >= VOLUME_TABLE_SIZE - 1) {
+        return table[VOLUME_TABLE_SIZE - 1] / 127.0;
+    }
+    int index = static_cast<int>(position);
+    double frac = position - index;
+    return (table[index] + (table[index + 1] - table[index]) * frac) / 127.0;
+}
+
+static inline bool validTempTable(const MappingParams &params) {
+    if (params.temp_points > TEMP_POINTS_MAX) {
+        return false;
+    }
+    for (int i = 1; i < params.temp_points; i++) {
+        if (params.temp_table[i].temp_x10 <= params.temp_table[i - 1].temp_x10) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns false when a value is out of range; nothing is changed then.
+static inline bool validParams(const MappingParams &params) {
+    if (params.scale >= SCALE_COUNT || params.root > ROOT_MAX) {
+        return false;
+    }
+    for (int i = 1; i < ZONE_COUNT - 1; i++) {
+        if (params.zone_edges[i] <= params.zone_edges[i - 1]) {
+            return false;
+        }
+    }
+    return params.smoothing_q8 >= 1 && params.smoothing_q8 <= SMOOTHING_OFF_Q8 &&
+           params.volume_max_deg > params.volume_min_deg && params.volume_curve_x10 >= 1 &&
+           params.volume_curve_x10 <= CURVE_MAX_X10 && params.sensor_rate_ms >= SENSOR_RATE_MIN_MS &&
+           params.sensor_rate_ms <= SENSOR_RATE_MAX_MS && params.output_format < OUTPUT_COUNT &&
+           params.glide_ms <= GLIDE_MS_MAX && params.sync_role < SYNC_ROLE_COUNT && params.trace <= 1 && params.pitch_follow <= 1 &&
+           params.plot_ms >= PLOT_RATE_MS_MIN && params.plot_ms <= PLOT_RATE_MS_MAX && validTempTable(params);
+}
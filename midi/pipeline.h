@@ -0,0 +1,60 @@
+#pragma once
+#include <cmath>    // For atan2, sqrt
+#include <stdint.h> // For int types
+
+// The accelerometer sample path as a chain of stage policies:
+//   decode -> orient -> filter -> quantize -> encode -> sink
+// Every stage is a struct with a static apply() that fills in its part of the
+// frame and returns false to drop the sample. Pipeline strings them together
+// at compile time and a build only contains the stages it names. Optimised,
+// each instance comes out as one straight function (test/bench_pipeline.cpp
+// times it against the stages called by hand); without optimisation the
+// apply() calls stay out of line. Play modes
+// are separate instances; switching mode picks an instance instead of every
+// stage testing the mode.
+
+struct SampleFrame {
+    int16_t x, y, z;    // raw counts after calibration
+    double roll, pitch; // degrees
+    int zone;           // roll zone, the scale degree
+    uint8_t note;
+    float volume;
+};
+
+template <class Decode, class Orient, class Filter, class Quantize, class Encode, class Sink>
+struct Pipeline {
+    static inline void run(const uint8_t *event_data) {
+        SampleFrame frame;
+        if (Decode::apply(event_data, frame) && Orient::apply(frame) && Filter::apply(frame) &&
+            Quantize::apply(frame) && Encode::apply(frame)) {
+            Sink::apply(frame);
+        }
+    }
+};
+
+// Two stages run one after the other in one slot, e.g. display then play.
+template <class First, class Second>
+struct Chain {
+    static inline bool apply(SampleFrame &frame) {
+        return First::apply(frame) && Second::apply(frame);
+    }
+};
+
+// Tilt from gravity alone, assuming the accelerometer measures nothing else.
+struct OrientGravity {
+    static inline bool apply(SampleFrame &frame) {
+        float scaleFactor = 32768.0f / 2.0f;
+        float x = static_cast<float>(frame.x) / scaleFactor;
+        float y = static_cast<float>(frame.y) / scaleFactor;
+        float z = static_cast<float>(frame.z) / scaleFactor;
+        frame.roll = atan2(y, z) * 180.0 / M_PI;
+        frame.pitch = atan2(-x, sqrt(y * y + z * z)) * 180.0 / M_PI;
+        return true;
+    }
+};
+
+struct NoFilter {
+    static inline bool apply(SampleFrame &) {
+        return true;
+    }
+};
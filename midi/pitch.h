@@ -0,0 +1,136 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Hummed pitch detection from the FFT stream, used to retune the roll
+// quantizer. Each FWGUI_EVENT_GUI_FFT_DATA event is taken to carry one slice
+// of a magnitude frame: the index of its first bin (uint16) followed by
+// FFT_EVENT_BINS uint16 magnitudes, all little-endian. A slice starting at
+// bin 0 begins a new frame.
+#define FFT_EVENT_BINS 16
+#define FFT_BIN_HZ_Q4 500        // bin width in 1/16 Hz (16 kHz mic, 512 point FFT)
+// Below ~250 Hz a semitone is under a quarter of a 31.25 Hz bin, too fine
+// for the interpolation to tell neighbouring notes apart. A low hum is
+// taken from its octave harmonic instead, which has the same pitch class.
+#define FFT_FIRST_BIN 8          // ignore everything below ~250 Hz
+#define FFT_LAST_BIN 34          // and anything above ~1 kHz
+#define FFT_MIN_MAGNITUDE 400    // weaker peaks are not a hummed note
+#define FFT_PROMINENCE_SHIFT 2   // peak must be 4x the average in-band bin
+#define FFT_STABLE_FRAMES 4      // same pitch class this many frames in a row
+
+#define PITCH_LOWEST_NOTE 36
+#define PITCH_NOTE_COUNT 49
+
+// Lower edge (a quarter tone below) of each note from C2 to C6 in 1/16 Hz,
+// plus the upper edge of the last one.
+static const uint16_t PITCH_NOTE_EDGES_Q4[PITCH_NOTE_COUNT + 1] = {
+    1017, 1077, 1141, 1209, 1281, 1357, 1438, 1523, 1614, 1710, 1812, 1919, 2033,
+    2154, 2282, 2418, 2562, 2714, 2876, 3047, 3228, 3420, 3623, 3839, 4067, 4309,
+    4565, 4836, 5124, 5429, 5751, 6093, 6456, 6840, 7246, 7677, 8134, 8617, 9130,
+    9673, 10248, 10857, 11503, 12187, 12911, 13679, 14493, 15354, 16267, 17235,
+};
+
+// MIDI note for a frequency in 1/16 Hz, or -1 when out of range.
+static inline int pitchToNote(uint32_t freq_q4) {
+    if (freq_q4 < PITCH_NOTE_EDGES_Q4[0] || freq_q4 >= PITCH_NOTE_EDGES_Q4[PITCH_NOTE_COUNT]) {
+        return -1;
+    }
+    int lo = 0;
+    int hi = PITCH_NOTE_COUNT;
+    while (hi - lo > 1) {
+        int mid = (lo + hi) / 2;
+        if (freq_q4 >= PITCH_NOTE_EDGES_Q4[mid]) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return PITCH_LOWEST_NOTE + lo;
+}
+
+// Incremental peak picker. Slices are scanned as they arrive, keeping only
+// the best bin and its neighbours, so no frame is ever buffered. When the
+// next frame starts, the peak is refined by parabolic interpolation.
+struct PitchFollower {
+    uint32_t best_mag;
+    uint32_t best_left;
+    uint32_t best_right;
+    uint32_t prev_mag;   // previous bin, the left neighbour of the next one
+    uint32_t band_sum;
+    uint16_t best_bin;
+    uint8_t have_peak;
+    int8_t candidate;    // pitch class seen in the last frames, -1 for none
+    uint8_t stable;
+    uint32_t frames;     // frames analysed, for the load report
+
+    // Returns a MIDI note once a hummed pitch has held for
+    // FFT_STABLE_FRAMES frames, otherwise -1.
+    int addEvent(const uint8_t *event_data) {
+        int detected = -1;
+        uint16_t first = static_cast<uint16_t>(event_data[0] | event_data[1] << 8);
+        if (first == 0) {
+            detected = finishFrame();
+        }
+
+        for (int i = 0; i < FFT_EVENT_BINS; i++) {
+            uint16_t bin = static_cast<uint16_t>(first + i);
+            uint32_t mag = static_cast<uint32_t>(event_data[2 + 2 * i] | event_data[3 + 2 * i] << 8);
+            if (have_peak && bin == best_bin + 1) {
+                best_right = mag;
+            }
+            if (bin >= FFT_FIRST_BIN && bin <= FFT_LAST_BIN) {
+                band_sum += mag;
+                if (mag > best_mag) {
+                    best_mag = mag;
+                    best_bin = bin;
+                    best_left = prev_mag;
+                    best_right = 0;
+                    have_peak = 1;
+                }
+            }
+            prev_mag = mag;
+        }
+        return detected;
+    }
+
+    int finishFrame() {
+        int result = -1;
+        frames++;
+        uint32_t average = band_sum / (FFT_LAST_BIN - FFT_FIRST_BIN + 1);
+        if (have_peak && best_mag >= FFT_MIN_MAGNITUDE && best_mag >= average << FFT_PROMINENCE_SHIFT) {
+            // Vertex of the parabola through the peak and its neighbours,
+            // offset = (L - R) / (2 (L - 2P + R)), in 1/256 bin
+            int32_t left = static_cast<int32_t>(best_left);
+            int32_t peak = static_cast<int32_t>(best_mag);
+            int32_t right = static_cast<int32_t>(best_right);
+            int32_t denom = left - 2 * peak + right;
+            int32_t offset_q8 = denom != 0 ? (128 * (left - right)) / denom : 0;
+            if (offset_q8 > 128) {
+                offset_q8 = 128;
+            } else if (offset_q8 < -128) {
+                offset_q8 = -128;
+            }
+            int32_t bin_q8 = (static_cast<int32_t>(best_bin) << 8) + offset_q8;
+            uint32_t freq_q4 = static_cast<uint32_t>(bin_q8) * FFT_BIN_HZ_Q4 >> 8;
+            int note = pitchToNote(freq_q4);
+            if (note >= 0) {
+                int8_t pitch_class = static_cast<int8_t>(note % 12);
+                if (pitch_class == candidate) {
+                    if (++stable == FFT_STABLE_FRAMES) {
+                        result = note;
+                    }
+                } else {
+                    candidate = pitch_class;
+                    stable = 1;
+                }
+            }
+        } else {
+            candidate = -1;
+            stable = 0;
+        }
+
+        best_mag = 0;
+        band_sum = 0;
+        have_peak = 0;
+        return result;
+    }
+};
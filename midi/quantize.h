@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Quantization grids, in MIDI clock ticks (24 per quarter note)
+#define QUANTIZE_OFF 0
+#define QUANTIZE_8TH 12
+#define QUANTIZE_16TH 6
+
+// Holds note changes from the sensor path until the next grid boundary of the
+// running clock. Volume is never held back, only the onset of a new note.
+// The velocity a note asked for is latched with it, so a note released on
+// the grid still starts with its own attack.
+struct NoteQuantizer {
+    uint8_t grid;         // ticks between boundaries, QUANTIZE_OFF to pass through
+    uint8_t emitted_note; // note the host is currently playing
+    uint8_t pending_note;
+    uint8_t has_pending;
+    uint8_t emitted_velocity;
+    uint8_t pending_velocity;
+
+    // Called for every sensor sample, returns the note to send now.
+    // velocity only counts on the sample a note is first asked for.
+    uint8_t request(uint8_t note, uint8_t velocity, bool clock_running) {
+        if (grid == QUANTIZE_OFF || !clock_running) {
+            if (note != emitted_note) {
+                emitted_velocity = velocity;
+            }
+            emitted_note = note;
+            has_pending = 0;
+            return note;
+        }
+        if (note != emitted_note && (!has_pending || note != pending_note)) {
+            pending_velocity = velocity;
+        }
+        pending_note = note;
+        has_pending = note != emitted_note;
+        return emitted_note;
+    }
+
+    // Called for every clock tick; tick_index 0 is the first tick after Start.
+    // Returns 1 when a held note has just been released onto the grid.
+    int onTick(uint32_t tick_index) {
+        if (!has_pending || grid == QUANTIZE_OFF || tick_index % grid != 0) {
+            return 0;
+        }
+        emitted_note = pending_note;
+        emitted_velocity = pending_velocity;
+        has_pending = 0;
+        return 1;
+    }
+
+    // Step through off, 1/8 and 1/16.
+    void cycle() {
+        grid = grid == QUANTIZE_OFF ? QUANTIZE_8TH : grid == QUANTIZE_8TH ? QUANTIZE_16TH : QUANTIZE_OFF;
+        has_pending = 0;
+    }
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include "fwwasm.h"
+#include <stdint.h> // For int types
+#include "config.h" // For FILE_OPEN_*
+
+// IR remote control. Any remote works: its codes are learned once, one key per
+// action, and kept in a small open-addressed hash table that is written to a
+// file as-is, so loading it is a single read and decoding a code in the event
+// drain is normally one probe.
+#define REMOTE_TABLE_BITS 4
+#define REMOTE_TABLE_SIZE (1 << REMOTE_TABLE_BITS) // over 3x the actions, probes rarely collide
+#define REMOTE_FILE "theremini-ir.bin"
+#define REMOTE_FILE_MAGIC 0x314D5249u // "IRM1"
+
+enum RemoteAction {
+    REMOTE_MODE,        // next play mode, like the blue button
+    REMOTE_SCALE,       // next scale
+    REMOTE_OCTAVE_UP,
+    REMOTE_OCTAVE_DOWN,
+    REMOTE_RECORD,      // looper, like the yellow button
+    REMOTE_PATTERN,     // next arpeggio pattern
+    REMOTE_FOLLOW,      // pitch following on or off
+
+    REMOTE_ACTION_COUNT,
+};
+
+// Learn mode asks for the keys in this order
+static const char *const REMOTE_PROMPTS[REMOTE_ACTION_COUNT] = {
+    "ir: press the key for mode\n",
+    "ir: press the key for scale\n",
+    "ir: press the key for octave up\n",
+    "ir: press the key for octave down\n",
+    "ir: press the key for record\n",
+    "ir: press the key for arpeggio pattern\n",
+    "ir: press the key for pitch following\n",
+};
+
+struct RemoteEntry {
+    uint32_t code;  // 0 marks an empty slot
+    uint8_t action; // RemoteAction
+};
+
+struct RemoteMap {
+    RemoteEntry slots[REMOTE_TABLE_SIZE];
+
+    static uint32_t slot(uint32_t code) {
+        // Fibonacci hashing, the top bits mix every bit of the code
+        return (code * 2654435761u) >> (32 - REMOTE_TABLE_BITS);
+    }
+
+    void clear() {
+        for (int i = 0; i < REMOTE_TABLE_SIZE; i++) {
+            slots[i].code = 0;
+        }
+    }
+
+    // Action bound to a code, or -1.
+    int find(uint32_t code) const {
+        uint32_t i = slot(code);
+        for (int probes = 0; probes < REMOTE_TABLE_SIZE; probes++) {
+            const RemoteEntry &entry = slots[i];
+            if (entry.code == code) {
+                return entry.action;
+            }
+            if (entry.code == 0) {
+                return -1;
+            }
+            i = (i + 1) & (REMOTE_TABLE_SIZE - 1);
+        }
+        return -1;
+    }
+
+    void insert(uint32_t code, uint8_t action) {
+        uint32_t i = slot(code);
+        while (slots[i].code != 0 && slots[i].code != code) {
+            i = (i + 1) & (REMOTE_TABLE_SIZE - 1);
+        }
+        slots[i].code = code;
+        slots[i].action = action;
+    }
+
+    // Returns false when there is no saved table or it is not ours.
+    bool load() {
+        int handle = openFile(REMOTE_FILE, FILE_OPEN_READ);
+        if (handle < 0) {
+            return false;
+        }
+        uint32_t magic = 0;
+        int bytes = sizeof(magic);
+        bool ok = readFile(handle, reinterpret_cast<unsigned char *>(&magic), &bytes) >= 0 &&
+                  bytes == sizeof(magic) && magic == REMOTE_FILE_MAGIC;
+        if (ok) {
+            bytes = sizeof(slots);
+            ok = readFile(handle, reinterpret_cast<unsigned char *>(slots), &bytes) >= 0 && bytes == sizeof(slots);
+        }
+        closeFile(handle);
+        if (!ok) {
+            clear();
+        }
+        return ok;
+    }
+
+    bool save() {
+        int handle = openFile(REMOTE_FILE, FILE_OPEN_WRITE);
+        if (handle < 0) {
+            return false;
+        }
+        uint32_t magic = REMOTE_FILE_MAGIC;
+        bool ok = writeFile(handle, reinterpret_cast<unsigned char *>(&magic), sizeof(magic)) == sizeof(magic) &&
+                  writeFile(handle, reinterpret_cast<unsigned char *>(slots), sizeof(slots)) == sizeof(slots);
+        closeFile(handle);
+        return ok;
+    }
+};
+
+// Walks through REMOTE_PROMPTS, binding the next code received to each action.
+struct RemoteLearner {
+    uint8_t active;
+    uint8_t action; // action waiting for a key
+
+    void start(RemoteMap &map) {
+        map.clear();
+        active = 1;
+        action = 0;
+    }
+
+    // Bind a code to the current action. Returns true once every action has
+    // a key. A key that is already bound is ignored so one key never does two
+    // things.
+    bool learn(RemoteMap &map, uint32_t code) {
+        if (map.find(code) >= 0) {
+            return false;
+        }
+        map.insert(code, action);
+        return next();
+    }
+
+    // Leave the current action unbound.
+    bool next() {
+        if (++action == REMOTE_ACTION_COUNT) {
+            active = 0;
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Number of accelerometer samples kept for the streaming detectors.
+// Must be a power of two so indexing is a mask instead of a modulo.
+#define SAMPLE_RING_SIZE 32
+
+// One raw accelerometer sample, stamped with millis() when it was received.
+struct AccelSample {
+    uint32_t t_ms;
+    int16_t x;
+    int16_t y;
+    int16_t z;
+};
+
+// Fixed-size history of the most recent accelerometer samples.
+// Nothing is ever allocated; the oldest sample is simply overwritten.
+struct SampleRing {
+    AccelSample samples[SAMPLE_RING_SIZE];
+    uint32_t count; // total samples pushed, used as the write cursor
+
+    void push(uint32_t t_ms, int16_t x, int16_t y, int16_t z) {
+        AccelSample &s = samples[count & (SAMPLE_RING_SIZE - 1)];
+        s.t_ms = t_ms;
+        s.x = x;
+        s.y = y;
+        s.z = z;
+        count++;
+    }
+
+    // Number of valid samples, saturating at the ring size.
+    uint32_t size() const {
+        return count < SAMPLE_RING_SIZE ? count : SAMPLE_RING_SIZE;
+    }
+
+    // age 0 is the newest sample, age size() - 1 the oldest.
+    const AccelSample &back(uint32_t age) const {
+        return samples[(count - 1 - age) & (SAMPLE_RING_SIZE - 1)];
+    }
+};
+
+static_assert((SAMPLE_RING_SIZE & (SAMPLE_RING_SIZE - 1)) == 0, "SAMPLE_RING_SIZE must be a power of two");
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Roll is split into 8 zones, one scale degree per zone, by default 22.5
+// degrees each over -90..90. Rolls past either end stay in the outer zone.
+#define ZONE_COUNT 8
+#define ZONE_MIN_DEG -90.0
+#define ZONE_WIDTH_DEG 22.5
+
+#define SCALE_MAX_STEPS 7
+
+enum ScaleId {
+    SCALE_MAJOR,
+    SCALE_MINOR,
+    SCALE_PENTATONIC,
+    SCALE_BLUES,
+
+    SCALE_COUNT,
+};
+
+// One octave of a scale; degrees past the end continue in the next octave.
+struct ScaleDef {
+    uint8_t length;
+    uint8_t steps[SCALE_MAX_STEPS];
+};
+
+// Same scales as the host bridge
+static const ScaleDef SCALES[SCALE_COUNT] = {
+    {7, {0, 2, 4, 5, 7, 9, 11}}, // major
+    {7, {0, 2, 3, 5, 7, 8, 10}}, // natural minor
+    {5, {0, 2, 4, 7, 9}},        // major pentatonic
+    {6, {0, 3, 5, 6, 7, 10}},    // blues
+};
+
+// Zone for a roll angle given the ZONE_COUNT - 1 ascending inner edges in
+// tenths of a degree. A roll exactly on an edge belongs to the lower zone.
+static inline int rollZone(double roll, const int16_t *edges_x10) {
+    double roll_x10 = roll * 10.0;
+    int zone = 0;
+    while (zone < ZONE_COUNT - 1 && roll_x10 > edges_x10[zone]) {
+        zone++;
+    }
+    return zone;
+}
+
+struct ScaleQuantizer {
+    uint8_t scale; // ScaleId
+    uint8_t root;  // MIDI note of degree 0
+
+    uint8_t note(int degree) const {
+        const ScaleDef &def = SCALES[scale];
+        int octave = degree / def.length;
+        int step = degree % def.length;
+        return static_cast<uint8_t>(root + def.steps[step] + 12 * octave);
+    }
+};
@@ -0,0 +1,82 @@
+#pragma once
+#include "fwwasm.h"
+#include <stdint.h> // For int types
+
+// Deadline scheduler shared by everything that has to happen at a point in
+// time rather than when an event arrives. Times are in microseconds derived
+// from millis() and wrap every ~71 minutes, so they are only ever compared
+// through timeReached().
+
+enum TaskId {
+    TASK_CLOCK,     // MIDI clock ticks and start/stop
+    TASK_ARP,       // arpeggiator steps
+    TASK_LOOP,      // looper playback
+    TASK_HEARTBEAT, // liveness line for the host watchdog
+    TASK_IMU,       // external gyro samples
+    TASK_SYNC,      // shared clock beacons from the leader
+    TASK_GLIDE,     // pitch bend ramp between notes
+    TASK_TRACE,     // trace blocks to the file, last so everything due first goes first
+
+    TASK_COUNT,
+};
+
+typedef void (*TaskFn)(uint32_t now_us);
+
+struct Task {
+    TaskFn fn;
+    uint32_t due_us;
+    uint8_t armed;
+};
+
+static Task sched_tasks[TASK_COUNT];
+
+static inline uint32_t nowUs() {
+    return millis() * 1000u;
+}
+
+static inline bool timeReached(uint32_t now_us, uint32_t due_us) {
+    return static_cast<int32_t>(now_us - due_us) >= 0;
+}
+
+static inline void schedInit(TaskId id, TaskFn fn) {
+    sched_tasks[id].fn = fn;
+    sched_tasks[id].armed = 0;
+}
+
+static inline void schedAt(TaskId id, uint32_t due_us) {
+    sched_tasks[id].due_us = due_us;
+    sched_tasks[id].armed = 1;
+}
+
+static inline bool schedArmed(TaskId id) {
+    return sched_tasks[id].armed;
+}
+
+static inline void schedCancel(TaskId id) {
+    sched_tasks[id].armed = 0;
+}
+
+// Earliest deadline of any armed task. Returns false when nothing is armed.
+static inline bool schedNextDue(uint32_t &due_us) {
+    bool any = false;
+    for (int i = 0; i < TASK_COUNT; i++) {
+        const Task &task = sched_tasks[i];
+        if (task.armed && (!any || static_cast<int32_t>(task.due_us - due_us) < 0)) {
+            due_us = task.due_us;
+            any = true;
+        }
+    }
+    return any;
+}
+
+// Run every task whose deadline has passed. Each task runs at most once per
+// call and is disarmed first, so it has to re-arm itself to run again.
+static inline void schedRun(uint32_t now_us) {
+    for (int i = 0; i < TASK_COUNT; i++) {
+        Task &task = sched_tasks[i];
+        if (task.armed && timeReached(now_us, task.due_us)) {
+            task.armed = 0;
+            task.fn(now_us);
+        }
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h> // For int types
+#include "ring.h"
+
+// Stillness detection for the low-power mode. The variance of each axis is
+// kept over the last STILL_WINDOW samples of the ring with running sums, so
+// every sample costs one add and one subtract per axis. Once idle, waking
+// only compares the newest sample against the resting position, so the first
+// sample that moves brings the device back.
+#define STILL_WINDOW 16           // samples, must be smaller than SAMPLE_RING_SIZE
+#define STILL_SHIFT 4             // raw counts >> 4, 1 LSB = 1/1024 g
+#define STILL_VARIANCE_MAX 150    // summed axis variance, about (0.012 g)^2
+#define STILL_WAKE_DELTA 40       // any axis this far from rest (~0.04 g) wakes
+#define STILL_IDLE_MS_DEFAULT 5000
+
+enum StillChange {
+    STILL_NO_CHANGE,
+    STILL_ENTERED_IDLE,
+    STILL_WOKE,
+};
+
+struct StillnessDetector {
+    int32_t sum[3];
+    int32_t sum_sq[3];
+    int32_t rest[3];        // mean position when idle started
+    uint32_t quiet_since_ms;
+    uint32_t idle_ms;       // how long to stay quiet before going idle
+    uint8_t quiet;
+    uint8_t idle;
+
+    static void axes(const AccelSample &s, int32_t v[3]) {
+        v[0] = s.x >> STILL_SHIFT;
+        v[1] = s.y >> STILL_SHIFT;
+        v[2] = s.z >> STILL_SHIFT;
+    }
+
+    int update(const SampleRing &ring) {
+        const AccelSample &newest = ring.back(0);
+        int32_t v[3];
+        axes(newest, v);
+        for (int i = 0; i < 3; i++) {
+            sum[i] += v[i];
+            sum_sq[i] += v[i] * v[i];
+        }
+        if (ring.size() > STILL_WINDOW) {
+            int32_t old[3];
+            axes(ring.back(STILL_WINDOW), old);
+            for (int i = 0; i < 3; i++) {
+                sum[i] -= old[i];
+                sum_sq[i] -= old[i] * old[i];
+            }
+        }
+
+        if (idle) {
+            for (int i = 0; i < 3; i++) {
+                int32_t delta = v[i] - rest[i];
+                if (delta > STILL_WAKE_DELTA || delta < -STILL_WAKE_DELTA) {
+                    idle = 0;
+                    quiet = 0;
+                    return STILL_WOKE;
+                }
+            }
+            return STILL_NO_CHANGE;
+        }
+
+        if (ring.size() <= STILL_WINDOW) {
+            return STILL_NO_CHANGE;
+        }
+
+        // N * sum_sq - sum^2 is N^2 times the variance, no division needed
+        int64_t spread = 0;
+        for (int i = 0; i < 3; i++) {
+            spread += static_cast<int64_t>(sum_sq[i]) * STILL_WINDOW - static_cast<int64_t>(sum[i]) * sum[i];
+        }
+        if (spread > static_cast<int64_t>(STILL_VARIANCE_MAX) * STILL_WINDOW * STILL_WINDOW) {
+            quiet = 0;
+            return STILL_NO_CHANGE;
+        }
+
+        if (!quiet) {
+            quiet = 1;
+            quiet_since_ms = newest.t_ms;
+        } else if (newest.t_ms - quiet_since_ms >= idle_ms) {
+            idle = 1;
+            for (int i = 0; i < 3; i++) {
+                rest[i] = sum[i] / STILL_WINDOW;
+            }
+            return STILL_ENTERED_IDLE;
+        }
+        return STILL_NO_CHANGE;
+    }
+};
@@ -0,0 +1,197 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Shared time base for several devices playing together. The leader
+// broadcasts its microsecond clock on the radio; followers never transmit,
+// they fit an offset and a drift to the beacons they hear and convert between
+// their own clock and the shared one. Radio use is bounded by construction:
+// one SYNC_BEACON_BYTES packet per SYNC_BEACON_MS from the leader alone, no
+// matter how many followers listen. The microsecond clocks wrap every 71.6
+// minutes, which is not a multiple of any step interval, so the beacon also
+// carries how many times the leader's clock has wrapped and the step grid is
+// worked out on the 64 bit shared time.
+#define SYNC_RADIO 1
+#define SYNC_BEACON_MS 1000
+#define SYNC_BEACON_BYTES 10     // 'T' 'S' seq, shared time (LE), wraps (LE), checksum
+#define SYNC_LINK_DELAY_US 2000  // typical one-way radio latency, added to the beacon time
+#define SYNC_STEP_US 20000       // errors this large re-anchor instead of slewing
+#define SYNC_STEP_BEACONS 3      // ...once they have repeated, so one stale beacon cannot
+#define SYNC_CLAMP_US 3000       // a single beacon moves the estimate at most this much
+#define SYNC_PHASE_SHIFT 3       // phase correction per beacon, 1/8 of the error
+#define SYNC_DRIFT_SHIFT 6       // drift correction per beacon, 1/64 of the error rate
+#define SYNC_MAX_DRIFT_Q4 16000  // +-1000 ppm, in ppm * 16
+#define SYNC_LOCKED_US 2000      // error counted as in lock
+#define SYNC_LOCK_BEACONS 4      // beacons in a row within SYNC_LOCKED_US to lock
+#define SYNC_LOST_MS 3500        // no beacon for this long drops the lock
+
+enum SyncRole {
+    SYNC_OFF,
+    SYNC_LEADER,
+    SYNC_FOLLOWER,
+
+    SYNC_ROLE_COUNT,
+};
+
+static inline uint8_t syncChecksum(const uint8_t *packet) {
+    uint8_t sum = 0;
+    for (int i = 0; i < SYNC_BEACON_BYTES - 1; i++) {
+        sum = static_cast<uint8_t>(sum + packet[i]);
+    }
+    return static_cast<uint8_t>(~sum);
+}
+
+static inline void syncBeacon(uint8_t *packet, uint8_t seq, uint64_t shared_us) {
+    packet[0] = 'T';
+    packet[1] = 'S';
+    packet[2] = seq;
+    for (int i = 0; i < 6; i++) {
+        packet[3 + i] = static_cast<uint8_t>(shared_us >> (8 * i));
+    }
+    packet[SYNC_BEACON_BYTES - 1] = syncChecksum(packet);
+}
+
+struct ClockSync {
+    uint8_t role;      // SyncRole
+    uint8_t anchored;  // a follower has heard at least one beacon
+    uint8_t locked;
+    uint8_t good;      // beacons in a row within SYNC_LOCKED_US
+    uint8_t far;       // beacons in a row beyond SYNC_STEP_US
+    uint8_t seq;
+    uint8_t rx[SYNC_BEACON_BYTES];
+    uint8_t rx_count;
+    uint32_t base_local;  // local time of the last correction
+    uint32_t base_shared; // shared time it was corrected to
+    int32_t drift_q4;     // how much faster the shared clock runs, ppm * 16
+    int32_t last_error_us;
+    uint32_t last_rx_ms;
+    uint32_t next_beacon_us; // the leader's next beacon deadline
+    uint64_t shared_ref;     // last shared time seen, with its wraps
+    uint32_t beacons;
+    uint32_t steps;
+
+    // Shared time for a local time. Only the leader and locked followers
+    // agree on it; anyone else gets their own clock back.
+    uint32_t sharedTime(uint32_t local_us) const {
+        if (role != SYNC_FOLLOWER || !anchored) {
+            return local_us;
+        }
+        int32_t dl = static_cast<int32_t>(local_us - base_local);
+        return base_shared + static_cast<uint32_t>(dl + static_cast<int32_t>(static_cast<int64_t>(dl) * drift_q4 / 16000000));
+    }
+
+    uint32_t localTime(uint32_t shared_us) const {
+        if (role != SYNC_FOLLOWER || !anchored) {
+            return shared_us;
+        }
+        int32_t ds = static_cast<int32_t>(shared_us - base_shared);
+        return base_local + static_cast<uint32_t>(ds - static_cast<int32_t>(static_cast<int64_t>(ds) * drift_q4 / 16000000));
+    }
+
+    // 64 bit shared time for one within half a wrap of the last one seen
+    uint64_t extend(uint32_t shared_us) const {
+        int32_t since = static_cast<int32_t>(shared_us - static_cast<uint32_t>(shared_ref));
+        return shared_ref + static_cast<uint64_t>(static_cast<int64_t>(since));
+    }
+
+    // The leader counts its own wraps from shared_ref set to its clock at
+    // boot; called at least every half wrap
+    void track(uint32_t shared_us) {
+        shared_ref = extend(shared_us);
+    }
+
+    // Local time of the first multiple of interval_us in shared time after
+    // local time after_us, so steps on every device land together.
+    uint32_t nextGrid(uint32_t after_us, uint32_t interval_us) const {
+        uint64_t shared = extend(sharedTime(after_us));
+        return localTime(static_cast<uint32_t>((shared / interval_us + 1) * interval_us));
+    }
+
+    bool synced() const {
+        return role == SYNC_LEADER || locked;
+    }
+
+    void anchor(uint32_t local_us, uint32_t shared_us) {
+        base_local = local_us;
+        base_shared = shared_us;
+        anchored = 1;
+        good = 0;
+        far = 0;
+        locked = 0;
+    }
+
+    // A beacon stamped shared_us by the leader was picked up at local_us.
+    void onBeacon(uint32_t shared_us, uint32_t local_us) {
+        beacons++;
+        uint32_t measured = shared_us + SYNC_LINK_DELAY_US;
+        if (!anchored) {
+            anchor(local_us, measured);
+            return;
+        }
+        uint32_t predicted = sharedTime(local_us);
+        int32_t error = static_cast<int32_t>(measured - predicted);
+        last_error_us = error;
+        if (error > SYNC_STEP_US || error < -SYNC_STEP_US) {
+            if (++far >= SYNC_STEP_BEACONS) {
+                steps++;
+                anchor(local_us, measured);
+            }
+            return;
+        }
+        far = 0;
+
+        // Late pickups (a busy loop pass) look like negative error; clamping
+        // keeps one of them from dragging the estimate.
+        if (error > SYNC_CLAMP_US) {
+            error = SYNC_CLAMP_US;
+        } else if (error < -SYNC_CLAMP_US) {
+            error = -SYNC_CLAMP_US;
+        }
+        int32_t elapsed = static_cast<int32_t>(local_us - base_local);
+        if (elapsed > 0) {
+            drift_q4 += static_cast<int32_t>(static_cast<int64_t>(error) * 16000000 / elapsed) >> SYNC_DRIFT_SHIFT;
+            if (drift_q4 > SYNC_MAX_DRIFT_Q4) {
+                drift_q4 = SYNC_MAX_DRIFT_Q4;
+            } else if (drift_q4 < -SYNC_MAX_DRIFT_Q4) {
+                drift_q4 = -SYNC_MAX_DRIFT_Q4;
+            }
+        }
+        base_local = local_us;
+        base_shared = predicted + static_cast<uint32_t>(error >> SYNC_PHASE_SHIFT);
+
+        if (last_error_us <= SYNC_LOCKED_US && last_error_us >= -SYNC_LOCKED_US) {
+            if (good < SYNC_LOCK_BEACONS && ++good == SYNC_LOCK_BEACONS) {
+                locked = 1;
+            }
+        } else {
+            good = 0;
+        }
+    }
+
+    // Feed received bytes; a packet that fails the checksum is dropped and
+    // the parser slides to the next 'T'. A good one also sets shared_ref,
+    // wraps and all.
+    bool feed(uint8_t byte, uint32_t &shared_us) {
+        if (rx_count == 0 && byte != 'T') {
+            return false;
+        }
+        if (rx_count == 1 && byte != 'S') {
+            rx_count = byte == 'T' ? 1 : 0;
+            return false;
+        }
+        rx[rx_count++] = byte;
+        if (rx_count < SYNC_BEACON_BYTES) {
+            return false;
+        }
+        rx_count = 0;
+        if (syncChecksum(rx) != rx[SYNC_BEACON_BYTES - 1]) {
+            return false;
+        }
+        uint64_t stamp = 0;
+        for (int i = 0; i < 6; i++) {
+            stamp |= static_cast<uint64_t>(rx[3 + i]) << (8 * i);
+        }
+        shared_ref = stamp + SYNC_LINK_DELAY_US;
+        shared_us = static_cast<uint32_t>(stamp);
+        return true;
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Accelerometer bias moves as the device warms up against the skin, enough
+// to shift the zone edges over a long set. A short table of per-axis offsets
+// at a few temperatures (from a calibration run, written to theremini.cfg as
+// "tempoffset" lines) is interpolated linearly for the current temperature.
+// Temperature changes slowly, so it is only looked at every TEMP_CHECK_MS
+// and the offsets are only recomputed when it has moved TEMP_STEP_X10; the
+// sample path just adds three cached numbers.
+#define TEMP_POINTS_MAX 6
+#define TEMP_CHECK_MS 1000
+#define TEMP_STEP_X10 5 // 0.5 C
+
+// Sensor events carry the temperature after x, y and z while it streams, as
+// a little-endian int16 in hundredths of a degree C
+#define TEMP_EVENT_OFFSET 6
+#define TEMP_EVENT_PER_X10 10
+
+struct TempPoint {
+    int16_t temp_x10;  // tenths of a degree C, ascending through the table
+    int16_t offset[3]; // raw counts to subtract from x, y, z at that temperature
+};
+
+// Offsets for a temperature, clamped to the ends of the table
+static inline void tempOffsets(const TempPoint *table, int count, int16_t temp_x10, int16_t *offset) {
+    if (count == 0) {
+        offset[0] = offset[1] = offset[2] = 0;
+        return;
+    }
+    int i = 1;
+    while (i < count && table[i].temp_x10 < temp_x10) {
+        i++;
+    }
+    const TempPoint &lo = table[i - 1];
+    if (i == count || temp_x10 <= lo.temp_x10) {
+        const TempPoint &end = i == count ? table[count - 1] : lo;
+        for (int axis = 0; axis < 3; axis++) {
+            offset[axis] = end.offset[axis];
+        }
+        return;
+    }
+    const TempPoint &hi = table[i];
+    int32_t span = hi.temp_x10 - lo.temp_x10;
+    int32_t along = temp_x10 - lo.temp_x10;
+    for (int axis = 0; axis < 3; axis++) {
+        offset[axis] = static_cast<int16_t>(lo.offset[axis] + (hi.offset[axis] - lo.offset[axis]) * along / span);
+    }
+}
+
+struct TempCompensator {
+    int16_t offset[3];
+    int16_t temp_x10; // temperature the offsets were computed for
+    uint8_t valid;
+    uint32_t next_ms;
+    uint32_t updates;
+
+    bool due(uint32_t now_ms) const {
+        return static_cast<int32_t>(now_ms - next_ms) >= 0;
+    }
+
+    // Returns true when the offsets changed.
+    bool update(uint32_t now_ms, int16_t reading_x10, const TempPoint *table, int count) {
+        next_ms = now_ms + TEMP_CHECK_MS;
+        int16_t moved = static_cast<int16_t>(reading_x10 > temp_x10 ? reading_x10 - temp_x10 : temp_x10 - reading_x10);
+        if (valid && moved < TEMP_STEP_X10) {
+            return false;
+        }
+        tempOffsets(table, count, reading_x10, offset);
+        temp_x10 = reading_x10;
+        valid = 1;
+        updates++;
+        return true;
+    }
+};
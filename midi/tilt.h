@@ -0,0 +1,73 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// Gravity estimate that ignores arm movement. The accelerometer measures
+// gravity plus whatever linear acceleration the hand adds, and only the
+// gravity part says how the device is tilted. A sample whose magnitude is
+// close to 1 g is taken as pure gravity and followed at once (no added lag
+// while playing slowly); the further the magnitude is from 1 g the less the
+// sample counts, and past TILT_REJECT_BAND the estimate holds still.
+// Sideways acceleration can leave the magnitude near 1 g, so as in a Kalman
+// update the gain also shrinks with the square of the innovation (how far
+// the sample is from the estimate): a hand can only rotate so far between
+// two samples. The gain never drops below TILT_GAIN_FLOOR, so a real fast
+// turn still arrives, a little late.
+#define TILT_ONE_G 16384      // raw counts per g at the +-2 g range
+#define TILT_TRUST_BAND 820   // within 0.05 g of 1 g, follow fully
+#define TILT_REJECT_BAND 4096 // 0.25 g off, freeze
+#define TILT_INNOVATION_TRUST 1600 // ~0.1 g between samples, a 500 deg/s turn at 100 Hz
+#define TILT_GAIN_ONE 256
+#define TILT_GAIN_FLOOR 16          // 1/16 per sample, ~160 ms to follow at 100 Hz
+
+struct TiltEstimator {
+    int32_t gx, gy, gz; // gravity estimate in raw counts
+    uint8_t primed;
+    uint32_t held;      // samples ignored outright, for tuning the bands
+
+    // Weight of a sample by its magnitude, TILT_GAIN_ONE for pure gravity
+    // down to 0.
+    static int32_t magnitudeGain(int32_t x, int32_t y, int32_t z) {
+        uint32_t mag_sq = static_cast<uint32_t>(x * x) + static_cast<uint32_t>(y * y) + static_cast<uint32_t>(z * z);
+        uint32_t one_sq = static_cast<uint32_t>(TILT_ONE_G) * TILT_ONE_G;
+        // |a|^2 - g^2 ~ 2 g (|a| - g), so the deviation in counts is the
+        // difference of squares over 2 g without a square root
+        uint32_t diff = mag_sq > one_sq ? mag_sq - one_sq : one_sq - mag_sq;
+        int32_t deviation = static_cast<int32_t>(diff / (2 * TILT_ONE_G));
+        if (deviation <= TILT_TRUST_BAND) {
+            return TILT_GAIN_ONE;
+        }
+        if (deviation >= TILT_REJECT_BAND) {
+            return 0;
+        }
+        return TILT_GAIN_ONE * (TILT_REJECT_BAND - deviation) / (TILT_REJECT_BAND - TILT_TRUST_BAND);
+    }
+
+    void update(int16_t x, int16_t y, int16_t z) {
+        if (!primed) {
+            gx = x;
+            gy = y;
+            gz = z;
+            primed = 1;
+            return;
+        }
+        int32_t weight = magnitudeGain(x, y, z);
+        if (weight == 0) {
+            held++;
+            return;
+        }
+        int32_t dx = x - gx;
+        int32_t dy = y - gy;
+        int32_t dz = z - gz;
+        int32_t innovation = dx < 0 ? -dx : dx;
+        innovation = dy > innovation ? dy : -dy > innovation ? -dy : innovation;
+        innovation = dz > innovation ? dz : -dz > innovation ? -dz : innovation;
+        if (innovation > TILT_INNOVATION_TRUST) {
+            int32_t ratio = TILT_GAIN_ONE * TILT_INNOVATION_TRUST / innovation;
+            int32_t trust = ratio * ratio / TILT_GAIN_ONE;
+            weight = weight * (trust < TILT_GAIN_FLOOR ? TILT_GAIN_FLOOR : trust) / TILT_GAIN_ONE;
+        }
+        gx += (dx * weight) / TILT_GAIN_ONE;
+        gy += (dy * weight) / TILT_GAIN_ONE;
+        gz += (dz * weight) / TILT_GAIN_ONE;
+    }
+};
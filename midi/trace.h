@@ -0,0 +1,176 @@
+#pragma once
+#include "fwwasm.h"
+#include <stdint.h> // For int types
+#include "config.h"
+
+// Rehearsal trace: accelerometer samples and what was played, in fixed size
+// records so a capture of any length can be memory mapped and searched
+// without being read whole. tracefile.py writes and reads the same layout.
+//
+//   file header, 16 bytes: magic "TMTR", version, record size, records per
+//                          block, reserved, start time (ms)
+//   blocks of TRACE_BLOCK_RECORDS records from byte 16 on:
+//     block header record: first and last record time, CRC-32 of the data
+//                          records, data record count, block number
+//     count data records, then zeros up to the block size
+//
+// Blocks sit at a fixed stride, so their headers are the time index: a
+// binary search over block first times finds any timestamp in O(log n).
+// Everything is little-endian, which wasm is.
+#define TRACE_FILE "theremini.trc"
+#define TRACE_MAGIC 0x52544D54 // "TMTR"
+#define TRACE_VERSION 1
+#define TRACE_BLOCK_RECORDS 64 // header + 63 data records, 1KB per write
+#define TRACE_VALUES 5
+
+enum TraceKind {
+    TRACE_SAMPLE = 1, // raw x, y, z counts as received
+    TRACE_NOTE,       // note, velocity (0 = off)
+    TRACE_CC,         // controller, value
+    TRACE_BEND,       // signed pitch bend, 0 is the center
+    TRACE_TEMP,       // raw temperature reading, each time it is checked
+    TRACE_GYRO,       // raw x, y, z gyro counts per read; channel 1 is the boot bias
+};
+
+struct TraceFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_bytes;
+    uint16_t block_records;
+    uint16_t reserved;
+    uint32_t start_ms;
+};
+
+struct TraceBlockHeader {
+    uint32_t first_ms;
+    uint32_t last_ms;
+    uint32_t crc;
+    uint16_t count;
+    uint16_t block; // low 16 bits of the block number, catches misplaced blocks
+};
+
+struct TraceRecord {
+    uint32_t time_ms;
+    uint8_t kind; // TraceKind
+    uint8_t channel;
+    int16_t value[TRACE_VALUES];
+};
+
+static_assert(sizeof(TraceFileHeader) == 16 && sizeof(TraceBlockHeader) == 16 && sizeof(TraceRecord) == 16,
+              "tracefile.py relies on 16 byte headers and records");
+
+// Same CRC as zlib.crc32, bit at a time: a block is checked once when
+// written, so a 1KB table is not worth its RAM.
+static inline uint32_t traceCrc(const uint8_t *data, uint32_t length) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+struct TraceBlock {
+    TraceBlockHeader header;
+    TraceRecord records[TRACE_BLOCK_RECORDS - 1];
+};
+
+// Collects records in RAM a block at a time, so the file sees one 1KB write
+// per ~0.6 s of playing instead of one per sample. There are two blocks:
+// when one fills, records carry on into the other and add() asks for the
+// full one to be written, which the caller does from a low priority task
+// rather than the sample path.
+struct TraceWriter {
+    int handle;      // -1 when not tracing, set at boot
+    uint8_t filling; // buffer records go into
+    uint8_t pending; // the other buffer is full and not written yet
+    uint8_t count;   // data records in the filling block so far
+    uint16_t block;
+    uint32_t blocks;
+    uint32_t failures;
+    TraceBlock buffers[2];
+
+    bool open(uint32_t start_ms) {
+        handle = openFile(TRACE_FILE, FILE_OPEN_WRITE);
+        if (handle < 0) {
+            return false;
+        }
+        TraceFileHeader header = {TRACE_MAGIC, TRACE_VERSION, sizeof(TraceRecord), TRACE_BLOCK_RECORDS, 0, start_ms};
+        if (writeFile(handle, reinterpret_cast<unsigned char *>(&header), sizeof(header)) != sizeof(header)) {
+            closeFile(handle);
+            handle = -1;
+            return false;
+        }
+        filling = 0;
+        pending = 0;
+        count = 0;
+        block = 0;
+        return true;
+    }
+
+    // Returns true when a block has just filled and wants write().
+    bool add(uint32_t time_ms, uint8_t kind, uint8_t channel, int16_t a, int16_t b, int16_t c) {
+        if (handle < 0) {
+            return false;
+        }
+        TraceRecord &record = buffers[filling].records[count];
+        record.time_ms = time_ms;
+        record.kind = kind;
+        record.channel = channel;
+        record.value[0] = a;
+        record.value[1] = b;
+        record.value[2] = c;
+        record.value[3] = 0;
+        record.value[4] = 0;
+        if (++count < TRACE_BLOCK_RECORDS - 1) {
+            return false;
+        }
+        if (pending) {
+            write(); // the writer is a whole block behind, keep the order
+        }
+        pending = 1;
+        filling ^= 1;
+        count = 0;
+        return true;
+    }
+
+    // Write the full block, if there is one
+    void write() {
+        if (handle < 0 || !pending) {
+            return;
+        }
+        writeBlock(buffers[filling ^ 1], TRACE_BLOCK_RECORDS - 1);
+        pending = 0;
+    }
+
+    void writeBlock(TraceBlock &buffer, uint8_t records) {
+        buffer.header.first_ms = buffer.records[0].time_ms;
+        buffer.header.last_ms = buffer.records[records - 1].time_ms;
+        buffer.header.crc = traceCrc(reinterpret_cast<const uint8_t *>(buffer.records), records * sizeof(TraceRecord));
+        buffer.header.count = records;
+        buffer.header.block = block++;
+        for (int i = records; i < TRACE_BLOCK_RECORDS - 1; i++) {
+            buffer.records[i] = TraceRecord();
+        }
+        if (writeFile(handle, reinterpret_cast<unsigned char *>(&buffer), sizeof(buffer)) == sizeof(buffer)) {
+            blocks++;
+        } else {
+            failures++;
+        }
+    }
+
+    void close() {
+        if (handle < 0) {
+            return;
+        }
+        write();
+        if (count) {
+            writeBlock(buffers[filling], count);
+            count = 0;
+        }
+        closeFile(handle);
+        handle = -1;
+    }
+};
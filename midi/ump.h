@@ -0,0 +1,118 @@
+#pragma once
+#include <stdint.h> // For int types
+
+// MIDI 2.0 Universal MIDI Packets for the live voice. Notes carry a 16 bit
+// velocity and their pitch as a 7.9 fixed point attribute, controllers and
+// pitch bend 32 bit values, so the angles reach the synth without going
+// through 7 bits first. Packets are appended to a fixed buffer and handed
+// to the sink in batches: once per loop pass, or early when the buffer
+// fills. Words go out most significant byte first.
+#define UMP_BUFFER_WORDS 32
+#define UMP_GROUP 0
+
+enum UmpType {
+    UMP_TYPE_SYSTEM = 0x1, // one word, realtime and common messages
+    UMP_TYPE_VOICE2 = 0x4, // two words, MIDI 2.0 channel voice
+};
+
+enum UmpStatus {
+    UMP_REGISTERED_CONTROL = 0x2,
+    UMP_NOTE_OFF = 0x8,
+    UMP_NOTE_ON = 0x9,
+    UMP_CONTROL = 0xB,
+    UMP_PITCH_BEND = 0xE,
+};
+
+#define UMP_ATTRIBUTE_PITCH 0x03 // note attribute: pitch in semitones, 7.9 fixed point
+#define UMP_BEND_CENTER 0x80000000u
+
+typedef void (*UmpSink)(const uint32_t *words, int count);
+
+static inline uint32_t umpVoiceHeader(uint8_t status, uint8_t channel, uint8_t index, uint8_t extra) {
+    return static_cast<uint32_t>(UMP_TYPE_VOICE2) << 28 | static_cast<uint32_t>(UMP_GROUP) << 24 |
+           static_cast<uint32_t>(status) << 20 | static_cast<uint32_t>(channel & 0x0F) << 16 |
+           static_cast<uint32_t>(index & 0x7F) << 8 | extra;
+}
+
+// 7 bit to 16 bit the way MIDI 2.0 translators do it: 0, 64 and 127 land
+// on 0, 0x8000 and 0xFFFF, the upper half fills in by repeating bits.
+static inline uint16_t umpScale7to16(uint8_t value) {
+    uint32_t scaled = static_cast<uint32_t>(value & 0x7F) << 9;
+    if (value > 64) {
+        uint32_t repeat = value & 0x3Fu;
+        scaled |= repeat << 3 | repeat >> 3;
+    }
+    return static_cast<uint16_t>(scaled);
+}
+
+// 0..1 to the full 32 bit range
+static inline uint32_t umpUnit32(double unit) {
+    if (unit <= 0.0) {
+        return 0;
+    }
+    if (unit >= 1.0) {
+        return 0xFFFFFFFFu;
+    }
+    return static_cast<uint32_t>(unit * 4294967295.0 + 0.5);
+}
+
+struct UmpBuffer {
+    uint32_t words[UMP_BUFFER_WORDS];
+    int count;
+    UmpSink sink;
+    uint32_t packets;
+    uint32_t flushes;
+
+    void flush() {
+        if (count) {
+            sink(words, count);
+            count = 0;
+            flushes++;
+        }
+    }
+
+    void add(uint32_t word0) {
+        if (count + 1 > UMP_BUFFER_WORDS) {
+            flush();
+        }
+        words[count++] = word0;
+        packets++;
+    }
+
+    void add(uint32_t word0, uint32_t word1) {
+        if (count + 2 > UMP_BUFFER_WORDS) {
+            flush();
+        }
+        words[count++] = word0;
+        words[count++] = word1;
+        packets++;
+    }
+
+    void noteOn(uint8_t channel, uint8_t note, uint16_t velocity, uint16_t pitch_7_9) {
+        add(umpVoiceHeader(UMP_NOTE_ON, channel, note, UMP_ATTRIBUTE_PITCH),
+            static_cast<uint32_t>(velocity) << 16 | pitch_7_9);
+    }
+
+    void noteOff(uint8_t channel, uint8_t note) {
+        add(umpVoiceHeader(UMP_NOTE_OFF, channel, note, 0), 0);
+    }
+
+    void control(uint8_t channel, uint8_t controller, uint32_t value) {
+        add(umpVoiceHeader(UMP_CONTROL, channel, controller, 0), value);
+    }
+
+    // Registered parameter number bank and index, e.g. 0, 0 for bend range
+    void registeredControl(uint8_t channel, uint8_t bank, uint8_t index, uint32_t value) {
+        add(umpVoiceHeader(UMP_REGISTERED_CONTROL, channel, bank, index & 0x7F), value);
+    }
+
+    void pitchBend(uint8_t channel, uint32_t value) {
+        add(umpVoiceHeader(UMP_PITCH_BEND, channel, 0, 0), value);
+    }
+
+    // Clock, start, stop...
+    void realtime(uint8_t status) {
+        add(static_cast<uint32_t>(UMP_TYPE_SYSTEM) << 28 | static_cast<uint32_t>(UMP_GROUP) << 24 |
+            static_cast<uint32_t>(status) << 16);
+    }
+};
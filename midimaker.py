@@ -1,10 +1,286 @@
 import math
+import threading
 import time
 from typing import Optional, Tuple
 import serial
 import rtmidi
 from rtmidi import MidiMessage
 import re
+import tracefile
+
+
+class ClockBridge:
+    """Generate MIDI clock for the DAW from the tempo the device reports.
+
+    Ticks are sent from absolute deadlines (start time + n * tick period), so
+    serial latency and thread wake-up jitter never accumulate into drift.
+    """
+
+    PPQN = 24
+    SPIN_SECONDS = 0.002  # busy-wait the last few ms, sleep() is too coarse on Windows
+
+    def __init__(self, midi_out, lock: threading.Lock):
+        self.midi_out = midi_out
+        self.lock = lock
+        self.bpm = 120.0
+        self.running = False
+        self.thread: Optional[threading.Thread] = None
+
+    def send(self, status: int):
+        with self.lock:
+            self.midi_out.sendMessage([status])
+
+    def set_tempo(self, bpm: float):
+        if bpm > 0:
+            self.bpm = bpm
+
+    def start(self):
+        if self.running:
+            return
+        self.running = True
+        self.send(0xFA)
+        self.thread = threading.Thread(target=self._run, daemon=True)
+        self.thread.start()
+
+    def stop(self):
+        if not self.running:
+            return
+        self.running = False
+        if self.thread is not None:
+            self.thread.join()
+            self.thread = None
+        self.send(0xFC)
+
+    def _run(self):
+        next_tick = time.perf_counter()
+        while self.running:
+            now = time.perf_counter()
+            if now >= next_tick:
+                self.send(0xF8)
+                next_tick += 60.0 / (self.bpm * self.PPQN)
+                continue
+            remaining = next_tick - now
+            if remaining > self.SPIN_SECONDS:
+                time.sleep(remaining - self.SPIN_SECONDS)
+
+
+class HeartbeatWatchdog:
+    """Release every sounding note when the device goes quiet.
+
+    The device prints "hb <n>" every 250 ms. If none arrives for longer than
+    the deadline (stalled USB link, pulled cable, crashed firmware), the
+    controller releases everything it is holding. Nothing happens until the
+    first heartbeat, so firmware without one is never cut off.
+    """
+
+    POLL_SECONDS = 0.02
+
+    def __init__(self, on_lapse, deadline: float = 1.0):
+        self.on_lapse = on_lapse
+        self.deadline = deadline
+        self.last_beat = None
+        self.tripped = False
+        self._running = False
+        self._thread = None
+
+    def beat(self):
+        if self.tripped:
+            print("Heartbeat back")
+            self.tripped = False
+        self.last_beat = time.monotonic()
+
+    def start(self):
+        self._running = True
+        self._thread = threading.Thread(target=self._run, daemon=True)
+        self._thread.start()
+
+    def stop(self):
+        self._running = False
+        if self._thread is not None:
+            self._thread.join()
+            self._thread = None
+
+    def _run(self):
+        while self._running:
+            time.sleep(self.POLL_SECONDS)
+            last = self.last_beat
+            if last is None or self.tripped:
+                continue
+            silent = time.monotonic() - last
+            if silent > self.deadline:
+                self.tripped = True
+                self.on_lapse()
+                # Detection latency is the silence past the deadline, at most
+                # one poll period plus the time on_lapse took
+                print(
+                    f"Heartbeat lost: notes released {silent * 1000:.0f} ms after the last beat "
+                    f"({(silent - self.deadline) * 1000:.0f} ms past the deadline)"
+                )
+
+
+class DeviceLineDecoder:
+    """Split the device's serial output into clean text lines.
+
+    Anything can come out of the port: undecodable bytes, ANSI escapes and
+    the console's "0134" prefix are dropped, and a line longer than MAX_LINE
+    is thrown away up to the next newline. Line noise therefore costs at most
+    the line it lands in (two if it eats a newline), and the decoder is back
+    in step at the next line end. The counters say how much was lost.
+    """
+
+    MAX_LINE = 96
+    ANSI_ESCAPE = re.compile(rb"\x1B(?:[@-Z\\-_]|\[[0-?]*[ -/]*[@-~])")
+    NOT_PRINTABLE = re.compile(rb"[^\x20-\x7E]")
+    CONSOLE_PREFIX = re.compile(r"^0?134")
+
+    def __init__(self):
+        self.buffer = bytearray()
+        self.discarding = False
+        self.lines = 0
+        self.bad_lines = 0  # decoded but not a line the bridge understands
+        self.resyncs = 0    # lines that needed cleaning or were thrown away
+        self.bytes_lost = 0
+
+    def feed(self, data: bytes):
+        """Return the complete lines in data, holding on to a partial one."""
+        lines = []
+        chunks = data.split(b"\n")
+        for i, chunk in enumerate(chunks):
+            ended = i < len(chunks) - 1
+            if self.discarding:
+                self.bytes_lost += len(chunk) + ended
+                self.discarding = not ended
+                continue
+            self.buffer += chunk
+            if len(self.buffer) > self.MAX_LINE:
+                self.resyncs += 1
+                self.bytes_lost += len(self.buffer) + ended
+                self.buffer.clear()
+                self.discarding = not ended
+                continue
+            if ended:
+                line = self._clean(bytes(self.buffer))
+                self.buffer.clear()
+                if line:
+                    self.lines += 1
+                    lines.append(line)
+        return lines
+
+    def _clean(self, raw: bytes) -> str:
+        raw = raw.rstrip(b"\r")
+        text = self.ANSI_ESCAPE.sub(b"", raw)
+        clean = self.NOT_PRINTABLE.sub(b"", text)
+        if len(clean) != len(text):
+            self.resyncs += 1
+            self.bytes_lost += len(text) - len(clean)
+        return self.CONSOLE_PREFIX.sub("", clean.decode("ascii")).strip()
+
+    def parse_note(self, parts) -> Optional[Tuple[int, int]]:
+        """Note and velocity from "<note> <volume>", None if it is not one."""
+        try:
+            note = int(float(parts[0]))
+            velocity = int(float(parts[1]))
+        except (ValueError, IndexError, OverflowError):
+            self.bad_lines += 1
+            return None
+        if len(parts) != 2 or not 0 <= note <= 127 or not 0 <= velocity <= 127:
+            self.bad_lines += 1
+            return None
+        return note, velocity
+
+    def summary(self) -> str:
+        per_resync = self.bytes_lost / self.resyncs if self.resyncs else 0.0
+        return (
+            f"{self.lines} lines, {self.bad_lines} bad, {self.resyncs} resyncs, "
+            f"{self.bytes_lost} bytes lost ({per_resync:.1f} per resync)"
+        )
+
+
+class DeviceCommands:
+    """Live mapping updates for the device, sent as SysEx on its UART.
+
+    Setters only stage values on the device; commit() makes it apply
+    everything staged so far in one piece at its next sensor sample.
+    """
+
+    MANUFACTURER = 0x7D  # non-commercial SysEx ID
+    CMD_SCALE = 1
+    CMD_ZONES = 2
+    CMD_FILTER = 3
+    CMD_VOLUME = 4
+    CMD_SENSOR_RATE = 5
+    CMD_OUTPUT = 6
+    CMD_COMMIT = 7
+    CMD_RESET = 8
+    CMD_PATTERN = 9
+
+    SCALES = {"major": 0, "minor": 1, "pentatonic": 2, "blues": 3}
+    PATTERNS = {"up": 0, "down": 1, "updown": 2, "random": 3}
+    OUTPUT_FLOAT = 0
+    OUTPUT_INT = 1
+    ROOT_MAX = 96           # ROOT_MAX in midi/params.h
+    SENSOR_RATE_MIN_MS = 5  # SENSOR_RATE_MIN_MS / _MAX_MS in midi/params.h
+    SENSOR_RATE_MAX_MS = 100
+
+    def __init__(self, serial_port: str, baudrate: int = 31250):
+        self.serial = serial.Serial(serial_port, baudrate)
+
+    @staticmethod
+    def _signed14(value: int):
+        value = int(value) + 8192
+        if not 0 <= value < 0x4000:
+            raise ValueError(f"{value - 8192} does not fit in 14 bits")
+        return [value & 0x7F, value >> 7]
+
+    def _send(self, command: int, data=()):
+        self.serial.write(bytes([0xF0, self.MANUFACTURER, command, *data, 0xF7]))
+
+    def set_scale(self, scale: str, root: int):
+        """Scale name and the MIDI note of its first degree."""
+        if not 0 <= root <= self.ROOT_MAX:
+            raise ValueError(f"root {root} is outside 0..{self.ROOT_MAX}")
+        self._send(self.CMD_SCALE, [self.SCALES[scale], root])
+
+    def set_zones(self, edges_deg):
+        """The 7 ascending roll angles between the 8 note zones."""
+        if len(edges_deg) != 7:
+            raise ValueError("need 7 zone edges")
+        data = []
+        for edge in edges_deg:
+            data += self._signed14(round(edge * 10))
+        self._send(self.CMD_ZONES, data)
+
+    def set_smoothing(self, weight: float):
+        """Weight of the newest angle, 1.0 turns smoothing off."""
+        self._send(self.CMD_FILTER, self._signed14(max(1, min(256, round(weight * 256)))))
+
+    def set_volume_range(self, min_deg: int, max_deg: int):
+        """Pitch angles that give volume 0 and 127."""
+        self._send(self.CMD_VOLUME, self._signed14(min_deg) + self._signed14(max_deg))
+
+    def set_sensor_rate(self, rate_ms: int):
+        if not self.SENSOR_RATE_MIN_MS <= rate_ms <= self.SENSOR_RATE_MAX_MS:
+            raise ValueError(f"sensor rate {rate_ms} ms is outside {self.SENSOR_RATE_MIN_MS}..{self.SENSOR_RATE_MAX_MS}")
+        self._send(self.CMD_SENSOR_RATE, [rate_ms])
+
+    def set_output_format(self, output_format: int):
+        if output_format not in (self.OUTPUT_FLOAT, self.OUTPUT_INT):
+            raise ValueError(f"unknown output format {output_format}")
+        self._send(self.CMD_OUTPUT, [output_format])
+
+    def set_arp_pattern(self, pattern: str):
+        """Arpeggio pattern, applied at once rather than staged."""
+        self._send(self.CMD_PATTERN, [self.PATTERNS[pattern]])
+
+    def commit(self):
+        self._send(self.CMD_COMMIT)
+
+    def reset(self):
+        """Drop anything staged but not committed."""
+        self._send(self.CMD_RESET)
+
+    def close(self):
+        self.serial.close()
 
 
 class MidiController:
@@ -13,8 +289,10 @@ class MidiController:
     MINOR_SCALE = [0, 2, 3, 5, 7, 8, 10, 12]
     PENTATONIC_SCALE = [0, 2, 4, 7, 9, 12, 14, 16]
     BLUES_SCALE = [0, 3, 5, 6, 7, 10, 12, 15]
+    BEND_RANGE = 12  # semitones, GLIDE_BEND_RANGE in the firmware
 
-    def __init__(self, serial_port: str, midi_channel: int = 0):
+    def __init__(self, serial_port: str, midi_channel: int = 0, heartbeat_deadline: float = 1.0,
+                 trace_path: Optional[str] = None, midi_out=None):
         self.current_octave = 4  # Start at middle octave
         self.base_octave = 4     # Reference octave for calculations
         self.current_scale = self.MAJOR_SCALE
@@ -23,22 +301,39 @@ class MidiController:
         self.powered = True
         self.show_guide = False
 
-        # MIDI setup with loopMIDI support
+        # MIDI setup with loopMIDI support, unless the caller brings its own
+        # output (the --bench harness records what would be sent)
         self.midi_channel = midi_channel
-        self.midi_out = rtmidi.RtMidiOut()
-
-        # Find and connect to loopMIDI port
-        port_number = self.find_loopmidi_port()
-        if port_number is not None:
-            self.midi_out.openPort(port_number)
-            print(f"Connected to loopMIDI port: {self.midi_out.getPortName(port_number)}")
+        if midi_out is not None:
+            self.midi_out = midi_out
         else:
-            print("No loopMIDI port found! Creating one...")
-            self.midi_out.openVirtualPort("FreeWilly MIDI")
-            print("Created virtual MIDI port: FreeWilly MIDI")
+            self.midi_out = rtmidi.RtMidiOut()
+
+            # Find and connect to loopMIDI port
+            port_number = self.find_loopmidi_port()
+            if port_number is not None:
+                self.midi_out.openPort(port_number)
+                print(f"Connected to loopMIDI port: {self.midi_out.getPortName(port_number)}")
+            else:
+                print("No loopMIDI port found! Creating one...")
+                self.midi_out.openVirtualPort("FreeWilly MIDI")
+                print("Created virtual MIDI port: FreeWilly MIDI")
+
+        # Looper layers from the device, voice -> (note, velocity)
+        self.loop_voices = {}
+
+        # Clock thread and the serial thread share the MIDI port
+        self.midi_lock = threading.Lock()
+        self.clock = ClockBridge(self.midi_out, self.midi_lock)
+        self.watchdog = HeartbeatWatchdog(self.release_all, heartbeat_deadline)
 
         # Serial setup
         self.serial_port = serial_port
+        self.decoder = DeviceLineDecoder()
+
+        # What the bridge played, in the device's trace layout (see tracefile.py)
+        self.trace = tracefile.TraceWriter(trace_path) if trace_path else None
+        self.trace_start = time.monotonic()
         self.current_midi_value = 60  # Middle C
         self.current_velocity = 64  # Middle velocity
 
@@ -89,61 +384,168 @@ class MidiController:
             self.midi_out.sendMessage(note_on_msg)
             self.last_velocity = self.current_velocity
 
-    def strip_ansi_codes(self, text: str) -> str:
-        """Remove ANSI escape codes from text."""
-        ansi_escape = re.compile(r"\x1B(?:[@-Z\\-_]|\[[0-?]*[ -/]*[@-~])")
-        return ansi_escape.sub("", text)
+    def send_voice(self, voice: int, note: int, velocity: int):
+        """Play a device looper layer on its own channel, after the live one."""
+        channel = self.midi_channel + voice + 1
+        last = self.loop_voices.get(voice)
+        if last is not None:
+            last_note, last_velocity = last
+            if last_note == note and abs(last_velocity - velocity) < 31:
+                return
+            self.midi_out.sendMessage(MidiMessage.noteOff(channel, last_note))
+        self.midi_out.sendMessage(MidiMessage.noteOn(channel, note, velocity))
+        self.loop_voices[voice] = (note, velocity)
+
+    def clear_voices(self):
+        for voice, (note, _) in self.loop_voices.items():
+            self.midi_out.sendMessage(
+                MidiMessage.noteOff(self.midi_channel + voice + 1, note)
+            )
+        self.loop_voices = {}
+
+    def release_all(self):
+        """Silence everything: the live note, looper voices and the clock."""
+        self.clock.stop()
+        with self.midi_lock:
+            if self.last_note is not None:
+                self.midi_out.sendMessage(MidiMessage.noteOff(self.midi_channel + 1, self.last_note))
+                self.last_note = None
+            self.clear_voices()
+            # All Notes Off on the live channel and every looper channel
+            for channel in range(self.midi_channel, self.midi_channel + 5):
+                self.midi_out.sendMessage([0xB0 | (channel & 0x0F), 123, 0])
+            # Recenter a glide cut off halfway
+            self.midi_out.sendMessage([0xE0 | self.midi_channel, 0, 64])
+
+    def record(self, kind: int, channel: int, *values: int):
+        if self.trace is not None:
+            time_ms = int((time.monotonic() - self.trace_start) * 1000)
+            self.trace.add(time_ms, kind, channel, *values)
+
+    def handle_heartbeat_line(self, parts) -> bool:
+        if parts[0] != "hb":
+            return False
+        self.watchdog.beat()
+        return True
+
+    def handle_loop_line(self, parts) -> bool:
+        """Handle looper playback ("v <voice> <note> <volume>") and "loop clear"."""
+        if parts[0] == "v" and len(parts) >= 4:
+            voice, note, velocity = int(parts[1]), int(parts[2]), int(parts[3])
+            with self.midi_lock:
+                self.send_voice(voice, note, velocity)
+            self.record(tracefile.NOTE, voice + 1, note, velocity)
+        elif parts[0] == "loop" and len(parts) >= 2 and parts[1] == "clear":
+            with self.midi_lock:
+                self.clear_voices()
+        else:
+            return False
+        return True
+
+    def handle_control_line(self, parts) -> bool:
+        """Handle "cc <controller> <value>" on the live channel."""
+        if parts[0] != "cc" or len(parts) < 3:
+            return False
+        controller = int(parts[1]) & 0x7F
+        value = int(parts[2]) & 0x7F
+        with self.midi_lock:
+            self.midi_out.sendMessage([0xB0 | self.midi_channel, controller, value])
+        self.record(tracefile.CC, 0, controller, value)
+        return True
+
+    def set_bend_range(self, semitones: int):
+        """Pitch bend sensitivity (RPN 0) on the live channel."""
+        status = 0xB0 | self.midi_channel
+        for controller, value in ((101, 0), (100, 0), (6, semitones & 0x7F), (38, 0), (101, 127), (100, 127)):
+            self.midi_out.sendMessage([status, controller, value])
+
+    def handle_bend_line(self, parts) -> bool:
+        """Handle device glide: "pb <0..16383>" and "bendrange <semitones>"."""
+        if parts[0] == "pb" and len(parts) >= 2:
+            value = max(0, min(16383, int(parts[1])))
+            with self.midi_lock:
+                self.midi_out.sendMessage([0xE0 | self.midi_channel, value & 0x7F, value >> 7])
+            self.record(tracefile.BEND, 0, value - 8192)
+        elif parts[0] == "bendrange" and len(parts) >= 2:
+            with self.midi_lock:
+                self.set_bend_range(int(parts[1]))
+        else:
+            return False
+        return True
+
+    def handle_clock_line(self, parts) -> bool:
+        """Handle start/stop/tempo lines from the device beat tracker."""
+        if parts[0] == "start":
+            self.clock.start()
+        elif parts[0] == "stop":
+            self.clock.stop()
+        elif parts[0] == "tempo" and len(parts) >= 2:
+            self.clock.set_tempo(float(parts[1]))
+            print(f"Tempo: {self.clock.bpm:.1f} BPM")
+        else:
+            return False
+        return True
+
+    def handle_line(self, data: str):
+        # Split the string on whitespace
+        parts = data.split()
+        if not parts:
+            return
+        if self.handle_heartbeat_line(parts):
+            return
+        if self.handle_clock_line(parts):
+            return
+        if self.handle_loop_line(parts):
+            return
+        if self.handle_control_line(parts):
+            return
+        if self.handle_bend_line(parts):
+            return
+        if parts[0].isalpha():
+            # Status lines (mode, idle/active, ...)
+            print(f"Device: {data}")
+            return
+        note = self.decoder.parse_note(parts)
+        if note is None:
+            print(f"Invalid data format: {data}")
+            return
+        self.current_midi_value, self.current_velocity = note
+        self.record(tracefile.NOTE, 0, *note)
+
+        with self.midi_lock:
+            self.send_midi_messages()
+
+        # Debug output
+        print(f"MIDI Note: {self.current_midi_value}, Velocity: {self.current_velocity}")
 
     def process_serial_data(self, baudrate: int = 9600, timeout: int = 1):
         try:
             with serial.Serial(self.serial_port, baudrate, timeout=timeout) as ser:
                 print(f"Connected to serial port: {self.serial_port}")
+                with self.midi_lock:
+                    self.set_bend_range(self.BEND_RANGE)
+                self.watchdog.start()
 
                 while self.powered:
-                    try:
-                        raw_data = ser.readline().decode("utf-8").strip()
-                        if raw_data:
-                            try:
-                                # Remove any prefixes and ANSI codes
-                                data = raw_data.replace("0134", "").replace("134", "")
-                                data = self.strip_ansi_codes(data)
-
-                                # Split the string on whitespace
-                                parts = data.split()
-                                if len(parts) >= 2:
-                                    midi_value = int(float(parts[0]))  # MIDI note value
-                                    velocity = int(float(parts[1]))  # MIDI velocity
-
-                                    # Ensure values are within MIDI ranges
-                                    self.current_midi_value = midi_value
-                                    self.current_velocity = velocity
-
-                                    self.send_midi_messages()
-
-                                    # Debug output
-                                    print(
-                                        f"MIDI Note: {self.current_midi_value}, Velocity: {self.current_velocity}"
-                                    )
-                                else:
-                                    print(
-                                        f"Invalid data format (not enough values): {raw_data}"
-                                    )
-
-                            except ValueError as e:
-                                print(
-                                    f"Could not parse values from '{raw_data}' -> '{data}': {e}"
-                                )
-                                continue
-
-                    except ValueError as e:
-                        print(f"Invalid data format: {e}")
-                        continue
+                    # Whatever is buffered, or wait up to the timeout for one byte
+                    for data in self.decoder.feed(ser.read(ser.in_waiting or 1)):
+                        try:
+                            self.handle_line(data)
+                        except ValueError as e:
+                            self.decoder.bad_lines += 1
+                            print(f"Could not parse values from '{data}': {e}")
 
         except KeyboardInterrupt:
             self.power_off()
         except serial.SerialException as e:
             print(f"Serial port error: {e}")
         finally:
+            print(f"Serial: {self.decoder.summary()}")
+            self.watchdog.stop()
+            if self.trace is not None:
+                self.trace.close()
+            self.clock.stop()
+            self.clear_voices()
             if self.last_note is not None:
                 self.midi_out.sendMessage(
                     [int(0x80 | self.midi_channel), int(self.last_note), 0]
@@ -151,17 +553,172 @@ class MidiController:
             self.midi_out.closePort()
 
 
+def fuzz_line_decoder(rounds: int = 20000, seed: int = 1):
+    """Feed corrupted device output through DeviceLineDecoder, no hardware.
+
+    Each round corrupts a short stream of real device lines once (bit flip,
+    dropped byte, garbage burst, runaway line, lost newline), splits it into
+    random reads and checks that nothing raises and that every line outside
+    the damage comes through intact.
+    """
+    import random
+    from collections import Counter
+
+    rng = random.Random(seed)
+    samples = [b"60.0 127.0", b"62 88", b"hb 1234", b"cc 11 96", b"v 2 67 100", b"pb 9557",
+               b"tempo 121.4", b"start", b"\x1b[0m0134mode 1"]
+    decoder = DeviceLineDecoder()
+    lost_lines = 0
+    worst = 0
+    for _ in range(rounds):
+        lines = [rng.choice(samples) for _ in range(6)]
+        stream = bytearray(b"\r\n".join(lines) + b"\r\n")
+        at = rng.randrange(len(stream))
+        kind = rng.randrange(5)
+        if kind == 0:
+            stream[at] ^= 1 << rng.randrange(8)
+        elif kind == 1:
+            del stream[at]
+        elif kind == 2:
+            stream[at:at] = bytes(rng.randrange(256) for _ in range(rng.randint(1, 8)))
+        elif kind == 3:
+            stream[at:at] = bytes(rng.randrange(0x30, 0x7B) for _ in range(rng.randint(100, 200)))
+        else:
+            at = stream.find(b"\n", at)
+            if at >= 0:
+                del stream[at]
+
+        out = []
+        pos = 0
+        while pos < len(stream):
+            size = rng.randint(1, 32)
+            out += decoder.feed(bytes(stream[pos:pos + size]))
+            pos += size
+        out += decoder.feed(b"\n")  # flush a line left open by the corruption
+        for line in out:
+            parts = line.split()
+            if parts and not parts[0].isalpha():
+                decoder.parse_note(parts)
+
+        expected = Counter(DeviceLineDecoder()._clean(line) for line in lines)
+        damaged = sum((expected - Counter(out)).values())
+        lost_lines += damaged
+        worst = max(worst, damaged)
+    print(f"{rounds} corruptions: {decoder.summary()}")
+    print(f"{lost_lines / rounds:.2f} lines lost per corruption, at most {worst}")
+
+
+class RecordingMidiOut:
+    """Stands in for the MIDI port: keeps every message with its send time."""
+
+    def __init__(self):
+        self.sent = []
+        self.lock = threading.Lock()
+
+    def sendMessage(self, message):
+        with self.lock:
+            self.sent.append((time.monotonic(), message))
+
+    def first_after(self, since: float, match):
+        with self.lock:
+            for at, message in self.sent:
+                if at >= since and match(message):
+                    return at
+        return None
+
+    def closePort(self):
+        pass
+
+
+def _is_note_on(note: int):
+    def match(message):
+        return hasattr(message, "isNoteOn") and message.isNoteOn() and message.getNoteNumber() == note
+    return match
+
+
+def _is_all_notes_off(message):
+    return isinstance(message, list) and len(message) == 3 and message[1] == 123
+
+
+def bench_link(lapses: int = 5, deadline: float = 0.5):
+    """Time the bridge end to end over a pseudo terminal, no hardware.
+
+    A thread plays the device on the master side of a pty: a note line and
+    a heartbeat every 250 ms, alternating two notes, then silence for a
+    while, then the same again. The controller reads the slave side through
+    pyserial exactly as it reads the real port and sends into a recording
+    MIDI output. Reported: line written to note-on sent, and last heartbeat
+    to All Notes Off compared with the deadline.
+    """
+    import contextlib
+    import io
+    import os
+    import pty
+    import statistics
+
+    master, slave = pty.openpty()
+    out = RecordingMidiOut()
+    controller = MidiController(os.ttyname(slave), heartbeat_deadline=deadline, midi_out=out)
+    reader = threading.Thread(target=controller.process_serial_data, kwargs={"timeout": 0.1}, daemon=True)
+
+    note_ms = []
+    release_ms = []
+    beat = 0
+    with contextlib.redirect_stdout(io.StringIO()):
+        reader.start()
+        time.sleep(0.2)
+        for lapse in range(lapses):
+            for step in range(8):
+                note = 60 + 2 * ((lapse * 8 + step) % 2)
+                written = time.monotonic()
+                os.write(master, f"{note} 100\r\nhb {beat}\r\n".encode())
+                beat += 1
+                time.sleep(0.25)
+                sent = out.first_after(written, _is_note_on(note))
+                if sent is not None:
+                    note_ms.append((sent - written) * 1000)
+            last_beat = time.monotonic() - 0.25
+            time.sleep(deadline + 0.3)
+            released = out.first_after(last_beat, _is_all_notes_off)
+            if released is not None:
+                release_ms.append((released - last_beat) * 1000)
+        controller.powered = False
+        reader.join(1.0)
+    os.close(master)
+    os.close(slave)
+
+    if note_ms:
+        print(f"line to note-on: median {statistics.median(note_ms):.2f} ms, "
+              f"worst {max(note_ms):.2f} ms over {len(note_ms)} notes")
+    print(f"heartbeat lapse: {len(release_ms)} of {lapses} released, deadline {deadline * 1000:.0f} ms")
+    if release_ms:
+        print(f"  released {min(release_ms) - deadline * 1000:.0f} to {max(release_ms) - deadline * 1000:.0f} ms "
+              f"past the deadline")
+
+
 def main():
     import sys
     import serial.tools.list_ports
 
+    if len(sys.argv) > 1 and sys.argv[1] == "--fuzz":
+        fuzz_line_decoder(int(sys.argv[2]) if len(sys.argv) > 2 else 20000)
+        return
+    if len(sys.argv) > 1 and sys.argv[1] == "--bench":
+        bench_link(int(sys.argv[2]) if len(sys.argv) > 2 else 5)
+        return
+
     SERIAL_PORT = "COM3"
     print(f"\nUsing serial port: {SERIAL_PORT}")
 
     MIDI_CHANNEL = 0  # MIDI channel 1
 
+    # --trace FILE records what is played, readable with tracefile.py
+    trace_path = None
+    if "--trace" in sys.argv[1:-1]:
+        trace_path = sys.argv[sys.argv.index("--trace") + 1]
+
     try:
-        controller = MidiController(SERIAL_PORT, MIDI_CHANNEL)
+        controller = MidiController(SERIAL_PORT, MIDI_CHANNEL, trace_path=trace_path)
         controller.process_serial_data()
     except KeyboardInterrupt:
         print("\nExiting...")
@@ -0,0 +1,82 @@
+#include "../midi/decimate.h"
+#include "check.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+// Cost per input sample of the CIC decimator for the ratios and stage
+// counts OVERSAMPLE_RATIO and OVERSAMPLE_STAGES might be set to, and how far
+// it takes white sensor noise down: about sqrt(Ratio), a little more with
+// more stages.
+
+#define BENCH_INPUTS 4000000
+#define BENCH_ROUNDS 5
+#define NOISE_SD 40.0
+
+static int16_t noise[3 * 4096];
+
+struct Measured {
+    double ns;
+    double sd;
+};
+
+template <int Ratio, int Stages>
+static Measured measure() {
+    static CicDecimator<Ratio, Stages> timed{};
+    volatile int sink = 0;
+    double best = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < BENCH_INPUTS; i++) {
+            int k = (i & 4095) * 3;
+            if (timed.add(noise[k], noise[k + 1], noise[k + 2])) {
+                sink = sink + timed.out[0];
+            }
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_INPUTS;
+        best = std::min(best, ns);
+    }
+
+    static CicDecimator<Ratio, Stages> filter{};
+    std::mt19937 rng(2);
+    std::normal_distribution<double> gauss(0.0, NOISE_SD);
+    double sum = 0.0, sum2 = 0.0;
+    int count = 0;
+    for (int i = 0; i < 200000; i++) {
+        int16_t value = static_cast<int16_t>(1000.0 + gauss(rng));
+        if (filter.add(value, value, value) && i > 1000) {
+            sum += filter.out[0];
+            sum2 += static_cast<double>(filter.out[0]) * filter.out[0];
+            count++;
+        }
+    }
+    double mean = sum / count;
+    Measured result = {best, std::sqrt(sum2 / count - mean * mean)};
+    printf("ratio %2d, %d stages: %5.2f ns per input sample, noise %.1f -> %.1f counts\n", Ratio, Stages, result.ns, NOISE_SD,
+           result.sd);
+    return result;
+}
+
+int main() {
+    std::mt19937 rng(1);
+    std::normal_distribution<double> gauss(0.0, NOISE_SD);
+    for (int16_t &value : noise) {
+        value = static_cast<int16_t>(1000.0 + gauss(rng));
+    }
+
+    Measured r2 = measure<2, 3>();
+    Measured r4 = measure<4, 3>();
+    Measured r8s2 = measure<8, 2>();
+    Measured r8 = measure<8, 3>();
+    Measured r16 = measure<16, 1>();
+
+    CHECK(r2.sd < NOISE_SD / std::sqrt(2.0) * 1.1);
+    CHECK(r4.sd < NOISE_SD / 2.0 * 1.1);
+    CHECK(r8.sd < NOISE_SD / std::sqrt(8.0) * 1.1);
+    CHECK(r8s2.sd < NOISE_SD / std::sqrt(8.0) * 1.1);
+    CHECK(r16.sd < NOISE_SD / 4.0 * 1.1);
+    // Generous: a handful of adds per axis should never cost this much
+    CHECK(r4.ns < 100.0 && r8.ns < 100.0);
+    return checkDone("bench_decimate");
+}
@@ -0,0 +1,72 @@
+#include "firmware.h"
+#include "check.h"
+#include <algorithm>
+#include <chrono>
+#include <type_traits>
+
+// The theremin sample path as composed from stage policies, against the
+// same stages called one after another by hand. Both run over the same
+// recorded-style sweep; the composed one should cost the same per sample.
+
+#if MOTION_REJECTION && EXTERNAL_IMU && ANGLE_SMOOTHING && ATTACK_VELOCITY && !UMP_OUTPUT
+static_assert(std::is_same_v<ThereminPath, Pipeline<DecodeAccel, Chain<Chain<Chain<RejectMotion, OrientGravity>, FuseGyro>, TrackAttack>,
+                                                    SmoothAngles, ScaleZones, PitchVolume, Chain<ShowSample, PlayNoteAttack>>>,
+              "the hand-written path below no longer matches ThereminPath");
+
+static void handThereminPath(const uint8_t *event_data) {
+    SampleFrame frame;
+    if (DecodeAccel::apply(event_data, frame) && RejectMotion::apply(frame) && OrientGravity::apply(frame) &&
+        FuseGyro::apply(frame) && TrackAttack::apply(frame) && SmoothAngles::apply(frame) && ScaleZones::apply(frame) && PitchVolume::apply(frame)) {
+        ShowSample::apply(frame) && PlayNoteAttack::apply(frame);
+    }
+}
+#else
+#error "bench_pipeline expects the default feature flags in main.cpp"
+#endif
+
+#define BENCH_SAMPLES 200000
+#define BENCH_ROUNDS 9
+
+static uint8_t sweep[BENCH_SAMPLES][FW_GET_EVENT_DATA_MAX];
+
+// One pass over the sweep
+static double nsPerSample(void (*run)(const uint8_t *)) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        run(sweep[i]);
+        fake::now_ms += 10;
+    }
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_SAMPLES;
+}
+
+static void composedThereminPath(const uint8_t *event_data) {
+    ThereminPath::run(event_data);
+}
+
+int main() {
+    bootFirmware();
+    fake::mute = true;
+    for (int i = 0; i < BENCH_SAMPLES; i++) {
+        double roll = 60.0 * sin(i * 0.002) * M_PI / 180.0;
+        double pitch = 30.0 * sin(i * 0.013) * M_PI / 180.0;
+        int16_t axes[3] = {static_cast<int16_t>(-16384.0 * sin(pitch)), static_cast<int16_t>(16384.0 * cos(pitch) * sin(roll)),
+                           static_cast<int16_t>(16384.0 * cos(pitch) * cos(roll))};
+        for (int axis = 0; axis < 3; axis++) {
+            sweep[i][2 * axis] = static_cast<uint8_t>(axes[axis]);
+            sweep[i][2 * axis + 1] = static_cast<uint8_t>(axes[axis] >> 8);
+        }
+    }
+
+    // Rounds alternate so a busy spell on the machine hits both, best of each
+    double composed = 1e30, by_hand = 1e30;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        composed = std::min(composed, nsPerSample(composedThereminPath));
+        by_hand = std::min(by_hand, nsPerSample(handThereminPath));
+    }
+    printf("theremin path: composed %.1f ns/sample, by hand %.1f ns/sample (%+.1f%%)\n", composed, by_hand,
+           100.0 * (composed - by_hand) / by_hand);
+    // Generous, this is a timing on a shared machine; it catches a stage
+    // that stopped inlining, not noise
+    CHECK(composed < by_hand * 1.25);
+    return checkDone("bench_pipeline");
+}
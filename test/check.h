@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdio>
+
+// Just enough of a test framework: CHECK records a failure and carries on,
+// checkDone() prints the tally and gives main() its exit code.
+static int check_failures = 0;
+static int check_count = 0;
+
+#define CHECK(cond) checkResult((cond), #cond, __FILE__, __LINE__)
+
+static inline bool checkResult(bool ok, const char *text, const char *file, int line) {
+    check_count++;
+    if (!ok) {
+        check_failures++;
+        printf("%s:%d: CHECK(%s) failed\n", file, line, text);
+    }
+    return ok;
+}
+
+static inline int checkDone(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, check_count, check_failures);
+    return check_failures ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+#include "fake_fwwasm.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace fake {
+uint32_t now_ms = 0;
+std::deque<FakeEvent> events;
+std::deque<uint8_t> uart_in;
+std::vector<uint8_t> uart_out;
+std::string log;
+bool echo = false;
+bool mute = false;
+FakeI2c i2c_read = nullptr;
+FakeI2c i2c_write = nullptr;
+uint32_t i2c_reads = 0;
+int radio_mode = RADIO_IDLE;
+std::deque<std::vector<uint8_t>> radio_rx;
+std::vector<std::vector<uint8_t>> radio_tx;
+bool card = false;
+std::vector<uint8_t> written;
+uint32_t writes = 0;
+std::map<std::string, std::string> files;
+static const std::string *reading = nullptr; // the file open for reading
+static size_t read_pos = 0;
+
+void pushSensor(int16_t x, int16_t y, int16_t z) {
+    FakeEvent event = {FWGUI_EVENT_GUI_SENSOR_DATA, std::vector<uint8_t>(8)};
+    int16_t axes[3] = {x, y, z};
+    for (int i = 0; i < 3; i++) {
+        event.data[static_cast<size_t>(2 * i)] = static_cast<uint8_t>(axes[i]);
+        event.data[static_cast<size_t>(2 * i + 1)] = static_cast<uint8_t>(axes[i] >> 8);
+    }
+    events.push_back(event);
+}
+
+void pushFft(uint16_t first_bin, const std::vector<uint16_t> &magnitudes) {
+    FakeEvent event = {FWGUI_EVENT_GUI_FFT_DATA, std::vector<uint8_t>(2 + 2 * magnitudes.size())};
+    event.data[0] = static_cast<uint8_t>(first_bin);
+    event.data[1] = static_cast<uint8_t>(first_bin >> 8);
+    for (size_t i = 0; i < magnitudes.size(); i++) {
+        event.data[2 + 2 * i] = static_cast<uint8_t>(magnitudes[i]);
+        event.data[3 + 2 * i] = static_cast<uint8_t>(magnitudes[i] >> 8);
+    }
+    events.push_back(event);
+}
+
+void reset() {
+    now_ms = 0;
+    events.clear();
+    uart_in.clear();
+    uart_out.clear();
+    log.clear();
+    echo = false;
+    mute = false;
+    i2c_read = nullptr;
+    i2c_write = nullptr;
+    i2c_reads = 0;
+    radio_mode = RADIO_IDLE;
+    radio_rx.clear();
+    radio_tx.clear();
+    card = false;
+    written.clear();
+    writes = 0;
+    files.clear();
+    reading = nullptr;
+}
+
+static void print(const std::string &text) {
+    log += text;
+    if (echo) {
+        fputs(text.c_str(), stdout);
+    }
+}
+} // namespace fake
+
+extern "C" {
+unsigned char __heap_base;
+
+void waitms(int milliseconds) {
+    fake::now_ms += static_cast<uint32_t>(milliseconds);
+}
+int wilirand(void) {
+    return rand();
+}
+unsigned int millis(void) {
+    return fake::now_ms;
+}
+
+int i2cRead(int address, int reg, unsigned char *data, int length) {
+    fake::i2c_reads++;
+    return fake::i2c_read ? fake::i2c_read(address, reg, data, length) : 0;
+}
+int i2cWrite(int address, int reg, unsigned char *data, int length) {
+    return fake::i2c_write ? fake::i2c_write(address, reg, data, length) : 0;
+}
+
+int UARTDataRxCount(void) {
+    return static_cast<int>(fake::uart_in.size());
+}
+int UARTDataRead(unsigned char *data, int length) {
+    for (int i = 0; i < length; i++) {
+        if (fake::uart_in.empty()) {
+            return 0;
+        }
+        data[i] = fake::uart_in.front();
+        fake::uart_in.pop_front();
+    }
+    return 1;
+}
+int UARTDataWrite(unsigned char *data, int length) {
+    fake::uart_out.insert(fake::uart_out.end(), data, data + length);
+    return length;
+}
+
+int RadioWrite(int, unsigned char *data, int length) {
+    if (fake::radio_mode != fake::RADIO_TX) {
+        return 0;
+    }
+    fake::radio_tx.emplace_back(data, data + length);
+    return 1;
+}
+int RadioGetRxCount(int) {
+    return fake::radio_mode == fake::RADIO_RX && !fake::radio_rx.empty() ? static_cast<int>(fake::radio_rx.front().size()) : 0;
+}
+int RadioRead(int, unsigned char *data, int length) {
+    if (fake::radio_mode != fake::RADIO_RX || fake::radio_rx.empty()) {
+        return 0;
+    }
+    std::vector<uint8_t> packet = fake::radio_rx.front();
+    fake::radio_rx.pop_front();
+    int count = static_cast<int>(packet.size()) < length ? static_cast<int>(packet.size()) : length;
+    memcpy(data, packet.data(), static_cast<size_t>(count));
+    return count;
+}
+int RadioSetTx(int) {
+    fake::radio_mode = fake::RADIO_TX;
+    return 1;
+}
+int RadioSetRx(int) {
+    fake::radio_mode = fake::RADIO_RX;
+    return 1;
+}
+int RadioSetIdle(int) {
+    fake::radio_mode = fake::RADIO_IDLE;
+    return 1;
+}
+
+int hasEvent(void) {
+    return !fake::events.empty();
+}
+int getEventData(unsigned char *data) {
+    FakeEvent event = fake::events.front();
+    fake::events.pop_front();
+    memcpy(data, event.data.data(), event.data.size());
+    return event.type;
+}
+
+void printInt(const char *format, printOutColor, printOutDataType, int value) {
+    if (fake::mute) {
+        return;
+    }
+    char text[256];
+    snprintf(text, sizeof(text), format, value);
+    fake::print(text);
+}
+void printFloat(const char *format, printOutColor, float value) {
+    if (fake::mute) {
+        return;
+    }
+    char text[256];
+    snprintf(text, sizeof(text), format, static_cast<double>(value));
+    fake::print(text);
+}
+
+void setBoardLED(int, int, int, int, int, LEDManagerLEDMode) {}
+void setSensorSettings(int, int, int, int, int, int, int, int, int, int, int, int, int) {}
+void setAudioSettings(int, int, int, int, int, int) {}
+void addPanel(int, int, int, int, int, int, int, int, int) {}
+void addControlPlotData(int, int, int, int) {}
+void addControlPlot(int, int, int, int, int, int, int, int, int, int, int, int, int) {}
+void addControlPictureFromFile(int, int, int, int, const char *, int) {}
+void showPanel(int) {}
+void setPlotData(int, int, int) {}
+void setControlValue(int, int, int) {}
+
+// Handle 3 writes, handle 4 reads
+int openFile(const char *name, int mode) {
+    if (mode == 0x01) { // FILE_OPEN_READ in midi/config.h
+        auto file = fake::files.find(name);
+        if (file == fake::files.end()) {
+            return -1;
+        }
+        fake::reading = &file->second;
+        fake::read_pos = 0;
+        return 4;
+    }
+    return fake::card && mode == 0x0A ? 3 : -1; // FILE_OPEN_WRITE
+}
+int closeFile(int handle) {
+    if (handle == 4) {
+        fake::reading = nullptr;
+    }
+    return 0;
+}
+int readFile(int handle, unsigned char *data, int *data_bytes) {
+    if (handle != 4 || !fake::reading) {
+        return -1;
+    }
+    size_t count = std::min(static_cast<size_t>(*data_bytes), fake::reading->size() - fake::read_pos);
+    memcpy(data, fake::reading->data() + fake::read_pos, count);
+    fake::read_pos += count;
+    *data_bytes = static_cast<int>(count);
+    return 0;
+}
+int writeFile(int handle, unsigned char *data, int length) {
+    if (!fake::card || handle != 3) {
+        return -1;
+    }
+    fake::written.insert(fake::written.end(), data, data + length);
+    fake::writes++;
+    return length;
+}
+// Up to *data_bytes characters, stopping after a newline
+int readFileLine(int handle, char *data, int *data_bytes) {
+    if (handle != 4 || !fake::reading || fake::read_pos >= fake::reading->size()) {
+        return -1;
+    }
+    int count = 0;
+    while (count < *data_bytes && fake::read_pos < fake::reading->size()) {
+        char c = (*fake::reading)[fake::read_pos++];
+        data[count++] = c;
+        if (c == '\n') {
+            break;
+        }
+    }
+    *data_bytes = count;
+    return count;
+}
+int getFileSize(int handle) {
+    return handle == 4 && fake::reading ? static_cast<int>(fake::reading->size()) : 0;
+}
+int getFilePosition(int handle) {
+    return handle == 4 && fake::reading ? static_cast<int>(fake::read_pos) : 0;
+}
+}
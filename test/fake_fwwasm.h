@@ -0,0 +1,51 @@
+#pragma once
+#include "../midi/fwwasm.h"
+#include <stdint.h> // For int types
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+// Native stand-ins for the FREE-WILi imports, so the firmware headers and
+// main.cpp run on the build machine. Time only moves through waitms(), and
+// everything the firmware would print is collected in fake::log.
+
+struct FakeEvent {
+    int type;
+    std::vector<uint8_t> data;
+};
+
+typedef int (*FakeI2c)(int address, int reg, unsigned char *data, int length);
+
+namespace fake {
+extern uint32_t now_ms;
+extern std::deque<FakeEvent> events;
+extern std::deque<uint8_t> uart_in;
+extern std::vector<uint8_t> uart_out;
+extern std::string log;
+extern bool echo; // also print the log to stdout
+extern bool mute; // print nothing at all, for benchmarks
+
+// I2C and radio 1. Without a device every I2C transfer fails.
+extern FakeI2c i2c_read;
+extern FakeI2c i2c_write;
+extern uint32_t i2c_reads;
+enum RadioMode { RADIO_IDLE, RADIO_RX, RADIO_TX };
+extern int radio_mode;
+extern std::deque<std::vector<uint8_t>> radio_rx;
+extern std::vector<std::vector<uint8_t>> radio_tx;
+
+// The SD card. Without one nothing opens for writing; with one, files opened
+// for writing all go to the same buffer. Files put in files can be opened for
+// reading, card or not, one at a time.
+extern bool card;
+extern std::vector<uint8_t> written;
+extern uint32_t writes;
+extern std::map<std::string, std::string> files;
+
+// An accelerometer event in the firmware's layout
+void pushSensor(int16_t x, int16_t y, int16_t z);
+// One FFT slice: the first bin, then its magnitudes, little-endian
+void pushFft(uint16_t first_bin, const std::vector<uint16_t> &magnitudes);
+void reset();
+} // namespace fake
@@ -0,0 +1,40 @@
+#pragma once
+#include "fake_fwwasm.h"
+
+// The whole firmware, globals and all; its main() becomes firmwareMain().
+#define main firmwareMain
+#include "../midi/main.cpp"
+#undef main
+
+// Runs the firmware's boot and shutdown without its loop, leaving every
+// task set up for a test to drive loop() itself.
+static inline void bootFirmware() {
+    exitApp = 1;
+    firmwareMain();
+    exitApp = 0;
+}
+
+// One accelerometer sample at the given roll and pitch in degrees, then one
+// loop pass, then time moves on by the sample interval.
+static inline void playSample(double roll_deg, double pitch_deg, int interval_ms) {
+    double roll = roll_deg * M_PI / 180.0;
+    double pitch = pitch_deg * M_PI / 180.0;
+    fake::pushSensor(static_cast<int16_t>(-16384.0 * sin(pitch)), static_cast<int16_t>(16384.0 * cos(pitch) * sin(roll)),
+                     static_cast<int16_t>(16384.0 * cos(pitch) * cos(roll)));
+    loop();
+    waitms(interval_ms);
+}
+
+// One FFT magnitude frame, queued as FFT_EVENT_BINS wide slices the way the
+// mic streams it, then one loop pass, then time moves on by the interval.
+static inline void playFftFrame(const std::vector<uint16_t> &bins, int interval_ms) {
+    for (size_t first = 0; first < bins.size(); first += FFT_EVENT_BINS) {
+        std::vector<uint16_t> slice(FFT_EVENT_BINS);
+        for (size_t i = 0; i < slice.size() && first + i < bins.size(); i++) {
+            slice[i] = bins[first + i];
+        }
+        fake::pushFft(static_cast<uint16_t>(first), slice);
+    }
+    loop();
+    waitms(interval_ms);
+}
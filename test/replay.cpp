@@ -0,0 +1,268 @@
+#include "firmware.h"
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Replays a rehearsal trace (midi/trace.h) through the whole firmware for
+// analyze.py. The firmware boots with the given theremini.cfg and then runs
+// its own loop as main() does, with each recorded accelerometer sample
+// arriving as a sensor event at its recorded time. Temperature readings go
+// back into the sample events and recorded gyro reads are served over the
+// fake I2C, so temperature offsets, oversampling, the gyro, note quantizing
+// and resting all behave as they did on the device.
+//
+//   replay TRACE [--config FILE] [--set LINE]... [--quantize TICKS] [--clock BPM]
+//
+// --set adds a config line after the file, --quantize sets the grid the gray
+// button would and --clock feeds an external MIDI clock. Motion rejection is
+// built in: replay has it, replay_raw does not. Prints one line of JSON with
+// the note changes the firmware played, compared against the zone the
+// unfiltered roll was in.
+
+#if !ANGLE_SMOOTHING
+#error "the replay reads the mapped roll from the smoothing stage"
+#endif
+
+#define NEAR_EDGE_X10 20 // "near a zone edge", tenths of a degree
+
+struct Trace {
+    uint32_t start_ms;
+    int bad_blocks;
+    std::vector<TraceRecord> records;
+};
+
+// Every block that passes its checks, in file order, as tracefile.py reads them
+static bool readTrace(const char *path, Trace &trace) {
+    std::ifstream in(path, std::ios::binary);
+    TraceFileHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) || header.magic != TRACE_MAGIC || header.version != TRACE_VERSION ||
+        header.record_bytes != sizeof(TraceRecord) || header.block_records != TRACE_BLOCK_RECORDS) {
+        return false;
+    }
+    trace.start_ms = header.start_ms;
+    trace.bad_blocks = 0;
+    TraceBlock block;
+    for (uint16_t number = 0; in.read(reinterpret_cast<char *>(&block), sizeof(block)); number++) {
+        uint16_t count = block.header.count;
+        if (count >= TRACE_BLOCK_RECORDS || block.header.block != number ||
+            traceCrc(reinterpret_cast<const uint8_t *>(block.records), count * sizeof(TraceRecord)) != block.header.crc) {
+            trace.bad_blocks++;
+            continue;
+        }
+        trace.records.insert(trace.records.end(), block.records, block.records + count);
+    }
+    return true;
+}
+
+// The recorded gyro. Reads return the boot bias until the first recorded
+// read, then the latest one at or before the current time.
+static std::vector<TraceRecord> gyro_reads;
+static size_t gyro_next = 0;
+static int16_t gyro_rate[3];
+
+static int gyroRead(int address, int reg, unsigned char *data, int length) {
+    if (address != IMU_ADDRESS) {
+        return 0;
+    }
+    if (reg == IMU_REG_WHO_AM_I && length == 1) {
+        data[0] = IMU_ADDRESS;
+        return 1;
+    }
+    if (reg != IMU_REG_GYRO_OUT || length != 6) {
+        return 0;
+    }
+    while (gyro_next < gyro_reads.size() && static_cast<int32_t>(millis() - gyro_reads[gyro_next].time_ms) >= 0) {
+        memcpy(gyro_rate, gyro_reads[gyro_next++].value, sizeof(gyro_rate));
+    }
+    for (int i = 0; i < 3; i++) {
+        data[2 * i] = static_cast<uint8_t>(gyro_rate[i] >> 8);
+        data[2 * i + 1] = static_cast<uint8_t>(gyro_rate[i]);
+    }
+    return 1;
+}
+
+static int gyroWrite(int, int, unsigned char *, int) {
+    return 1;
+}
+
+struct Stats {
+    uint32_t samples; // mapped, so not while resting
+    uint32_t changes;
+    uint32_t spurious; // note changes the unfiltered roll never asked for
+    uint32_t near_edge;
+    std::vector<uint32_t> latency_ms; // hand entering a zone to its note
+    std::vector<uint32_t> velocity;
+};
+
+static void printList(const char *name, const std::vector<uint32_t> &values) {
+    printf(", \"%s\": [", name);
+    for (size_t i = 0; i < values.size(); i++) {
+        printf(i ? ", %u" : "%u", static_cast<unsigned>(values[i]));
+    }
+    printf("]");
+}
+
+int main(int argc, char **argv) {
+    const char *path = nullptr;
+    std::string config;
+    int quantize = QUANTIZE_OFF;
+    double bpm = 0.0;
+    for (int i = 1; i < argc; i++) {
+        bool value = i + 1 < argc;
+        if (!strcmp(argv[i], "--config") && value) {
+            std::ifstream in(argv[++i]);
+            if (!in) {
+                fprintf(stderr, "replay: cannot read %s\n", argv[i]);
+                return 2;
+            }
+            std::stringstream text;
+            text << in.rdbuf();
+            config = text.str() + "\n" + config;
+        } else if (!strcmp(argv[i], "--set") && value) {
+            config += std::string(argv[++i]) + "\n";
+        } else if (!strcmp(argv[i], "--quantize") && value) {
+            quantize = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--clock") && value) {
+            bpm = atof(argv[++i]);
+        } else if (!path && argv[i][0] != '-') {
+            path = argv[i];
+        } else {
+            path = nullptr;
+            break;
+        }
+    }
+    if (!path) {
+        fprintf(stderr, "usage: replay TRACE [--config FILE] [--set LINE]... [--quantize TICKS] [--clock BPM]\n");
+        return 2;
+    }
+    Trace trace;
+    if (!readTrace(path, trace)) {
+        fprintf(stderr, "replay: %s is not a trace\n", path);
+        return 2;
+    }
+
+    for (const TraceRecord &record : trace.records) {
+        if (record.kind == TRACE_GYRO && record.channel == 1) {
+            memcpy(gyro_rate, record.value, sizeof(gyro_rate));
+            fake::i2c_read = gyroRead;
+            fake::i2c_write = gyroWrite;
+        } else if (record.kind == TRACE_GYRO) {
+            gyro_reads.push_back(record);
+        }
+    }
+    fake::mute = true;
+    fake::files[CONFIG_FILE] = config;
+    fake::now_ms = trace.start_ms;
+    bootFirmware();
+    if (config_report.ignored || config_report.rejected) {
+        fprintf(stderr, "replay: %d config lines ignored%s\n", config_report.ignored,
+                config_report.rejected ? ", the rest rejected" : "");
+        return 2;
+    }
+    quantizer.grid = static_cast<uint8_t>(quantize);
+
+    Stats stats = {};
+    uint32_t first_ms = 0;
+    uint32_t last_ms = 0;
+    bool started = false;
+    uint8_t note = 0;
+    int raw_zone = -1;
+    uint32_t raw_since = 0;
+    double clock_ms = 0.0; // next external clock tick
+    int16_t temp_reading = 0;
+
+    // One pass of the firmware's loop, with the clock ticks due by now
+    auto runLoop = [&]() {
+        if (bpm > 0.0 && started) {
+            while (millis() >= clock_ms) {
+                fake::uart_in.push_back(MIDI_CLOCK);
+                clock_ms += 60000.0 / (bpm * 24.0);
+            }
+        }
+        loop();
+    };
+    // A note change the pass made
+    auto noteChange = [&]() {
+        if (!started || quantizer.emitted_note == note) {
+            return;
+        }
+        note = quantizer.emitted_note;
+        stats.changes++;
+        stats.velocity.push_back(quantizer.emitted_velocity);
+        if (note != scale_quantizer.note(raw_zone)) {
+            stats.spurious++;
+        } else {
+            stats.latency_ms.push_back(millis() - raw_since);
+        }
+    };
+
+    for (const TraceRecord &record : trace.records) {
+        if (record.kind == TRACE_TEMP) {
+            temp_reading = record.value[0];
+            continue;
+        }
+        if (record.kind != TRACE_SAMPLE) {
+            continue;
+        }
+        // As main() does until the sample is due
+        while (static_cast<int32_t>(record.time_ms - millis()) > 0) {
+            runLoop();
+            noteChange();
+            int left_ms = static_cast<int>(record.time_ms - millis());
+            int sleep_ms = loopSleepMs();
+            waitms(sleep_ms < left_ms ? sleep_ms : left_ms);
+        }
+
+        fake::pushSensor(record.value[0], record.value[1], record.value[2]);
+        FakeEvent &event = fake::events.back();
+        event.data[TEMP_EVENT_OFFSET] = static_cast<uint8_t>(temp_reading);
+        event.data[TEMP_EVENT_OFFSET + 1] = static_cast<uint8_t>(temp_reading >> 8);
+        if (!started) {
+            first_ms = record.time_ms;
+            if (bpm > 0.0) {
+                fake::uart_in.push_back(MIDI_START);
+                clock_ms = record.time_ms;
+            }
+        }
+        last_ms = record.time_ms;
+        runLoop();
+
+        // What the hand asked for: the sample with only the offsets taken
+        // off, before any filtering
+        SampleFrame raw = {};
+        raw.x = static_cast<int16_t>(record.value[0] - params.accel_offset[0] - temp_comp.offset[0]);
+        raw.y = static_cast<int16_t>(record.value[1] - params.accel_offset[1] - temp_comp.offset[1]);
+        raw.z = static_cast<int16_t>(record.value[2] - params.accel_offset[2] - temp_comp.offset[2]);
+        OrientGravity::apply(raw);
+        int zone = rollZone(raw.roll, params.zone_edges);
+        if (zone != raw_zone) {
+            raw_zone = zone;
+            raw_since = record.time_ms;
+        }
+        noteChange();
+        if (!started) {
+            started = true;
+            note = quantizer.emitted_note;
+        }
+        if (!stillness.idle) {
+            stats.samples++;
+            double roll_x10 = smooth_roll * 10.0;
+            for (int16_t edge : params.zone_edges) {
+                if (fabs(roll_x10 - edge) < NEAR_EDGE_X10) {
+                    stats.near_edge++;
+                    break;
+                }
+            }
+        }
+    }
+
+    printf("{\"seconds\": %.3f, \"samples\": %u, \"changes\": %u, \"spurious\": %u, \"near_edge\": %u, \"bad_blocks\": %d",
+           (last_ms - first_ms) / 1000.0, static_cast<unsigned>(stats.samples), static_cast<unsigned>(stats.changes),
+           static_cast<unsigned>(stats.spurious), static_cast<unsigned>(stats.near_edge), trace.bad_blocks);
+    printList("latency_ms", stats.latency_ms);
+    printList("velocity", stats.velocity);
+    printf("}\n");
+    return 0;
+}
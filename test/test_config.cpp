@@ -0,0 +1,66 @@
+#include "firmware.h"
+#include "check.h"
+#include <cstring>
+
+// A bad theremini.cfg line is ignored on its own, whatever is wrong with it,
+// and the rest of the file still applies: out of order values are caught by
+// the line parser, not left for validParams to throw the whole file away.
+
+struct ConfigCase {
+    const char *line;
+    bool ok;
+};
+
+static const ConfigCase CASES[] = {
+    {"root 57", true},
+    {"root 97", false},
+    {"zones -60 -40 -20 0 20 40 60", true},
+    {"zones -60 -40 -20 20 0 40 60", false}, // not ascending
+    {"zones -60 -40 -20 0 0 40 60", false},  // two edges the same
+    {"volume -20 40", true},
+    {"volume 30 -30", false},
+    {"volume 10 10", false},
+    {"curve 1.5", true},
+    {"curve 1.5x", false},
+    {"rate 10ms", false},
+    {"smoothing 0.5.5", false},
+    {"offset 12 -40 85", true},
+    {"offset 12 -40 40000", false},
+    {"offset 99999999999 0 0", false}, // would overflow int32
+    {"tempoffset 20 4 -9 20", true},
+    {"tempoffset 31.5 6 -12 25", true},
+    {"tempoffset 25 5 -10 22", false}, // below the last point
+    {"tempoffset 31.5 6 -12 25", false},
+    {"tempoffset 40 8 -15 30", true},
+    {"glide 120", true},
+    {"plot 100", true},
+    {"plot 5", false},
+};
+
+int main() {
+    bootFirmware();
+    MappingParams parsed = defaultParams(MIDI_NOTE, SENSOR_RATE_MS);
+    int ignored = 0;
+    for (const ConfigCase &test : CASES) {
+        MappingParams before = parsed;
+        bool ok = configLine(test.line, parsed);
+        if (ok != test.ok) {
+            printf("\"%s\" gave %d\n", test.line, ok);
+        }
+        CHECK(ok == test.ok);
+        if (!ok) {
+            ignored++;
+            CHECK(memcmp(&before, &parsed, sizeof(parsed)) == 0);
+        }
+    }
+    printf("%d lines ignored\n", ignored);
+
+    // Every good line applied and the result is still valid
+    CHECK(validParams(parsed));
+    CHECK(parsed.root == 57 && parsed.zone_edges[3] == 0);
+    CHECK(parsed.volume_min_deg == -20 && parsed.volume_max_deg == 40);
+    CHECK(parsed.volume_curve_x10 == 15 && parsed.accel_offset[2] == 85);
+    CHECK(parsed.temp_points == 3 && parsed.temp_table[2].temp_x10 == 400);
+    CHECK(parsed.glide_ms == 120 && parsed.plot_ms == 100);
+    return checkDone("test_config");
+}
@@ -0,0 +1,138 @@
+#include "firmware.h"
+#include "check.h"
+
+// A fake MPU-6050 class gyro on the I2C bus, and the boot paths around it:
+// found, calibrated and integrating; absent or floating, and the firmware
+// carrying on with the accelerometer alone.
+
+#define DEVICE_BIAS_X 120
+#define DEVICE_BIAS_Y -45
+#define DEVICE_READS_PER_MS 4 // 250 us per register burst
+
+struct FakeImu {
+    uint8_t who_am_i;
+    bool rates_fail;
+    int16_t rate[3]; // on top of the bias, raw counts
+    uint8_t pwr_mgmt;
+    uint8_t gyro_config;
+    uint32_t bursts;
+};
+
+static FakeImu imu_device;
+
+static int fakeImuRead(int address, int reg, unsigned char *data, int length) {
+    if (address != IMU_ADDRESS) {
+        return 0;
+    }
+    if (reg == IMU_REG_WHO_AM_I && length == 1) {
+        data[0] = imu_device.who_am_i;
+        return 1;
+    }
+    if (reg == IMU_REG_GYRO_OUT && length == 6) {
+        if (imu_device.rates_fail) {
+            return 0;
+        }
+        // The bus time shows up on the millisecond clock every few bursts
+        if (++imu_device.bursts % DEVICE_READS_PER_MS == 0) {
+            fake::now_ms++;
+        }
+        int16_t counts[3] = {static_cast<int16_t>(DEVICE_BIAS_X + imu_device.rate[0]),
+                             static_cast<int16_t>(DEVICE_BIAS_Y + imu_device.rate[1]), imu_device.rate[2]};
+        for (int i = 0; i < 3; i++) {
+            data[2 * i] = static_cast<uint8_t>(static_cast<uint16_t>(counts[i]) >> 8);
+            data[2 * i + 1] = static_cast<uint8_t>(counts[i]);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static int fakeImuWrite(int address, int reg, unsigned char *data, int length) {
+    if (address != IMU_ADDRESS || length != 1) {
+        return 0;
+    }
+    if (reg == IMU_REG_PWR_MGMT_1) {
+        imu_device.pwr_mgmt = data[0];
+    } else if (reg == IMU_REG_GYRO_CONFIG) {
+        imu_device.gyro_config = data[0];
+    }
+    return 1;
+}
+
+static void plugIn(uint8_t who_am_i) {
+    fake::reset();
+    imu_device = FakeImu{who_am_i, false, {0, 0, 0}, 0x40, 0, 0};
+    fake::i2c_read = fakeImuRead;
+    fake::i2c_write = fakeImuWrite;
+    gyro_fusion = GyroFusion();
+}
+
+int main() {
+    // Present: woken, set to 500 deg/s, bias measured, burst timed
+    plugIn(0x68);
+    CHECK(gyro_fusion.probe(nowUs()));
+    CHECK(gyro_fusion.present == 1);
+    CHECK(imu_device.pwr_mgmt == 0);
+    CHECK(imu_device.gyro_config == IMU_GYRO_500DPS);
+    CHECK(gyro_fusion.bias[0] == DEVICE_BIAS_X && gyro_fusion.bias[1] == DEVICE_BIAS_Y);
+    CHECK(gyro_fusion.read_us == 1000 / DEVICE_READS_PER_MS);
+    printf("probe: bias %d, %d, %u us per burst\n", static_cast<int>(gyro_fusion.bias[0]),
+           static_cast<int>(gyro_fusion.bias[1]), static_cast<unsigned>(gyro_fusion.read_us));
+
+    // Integrating: 10 deg/s of roll for one second at the gyro rate
+    double roll = 0.0, pitch = 0.0;
+    gyro_fusion.fuse(roll, pitch);
+    imu_device.rate[0] = IMU_COUNTS_PER_DPS_X10;
+    uint32_t now_us = gyro_fusion.last_us;
+    for (int n = 0; n < 1000000 / IMU_PERIOD_US; n++) {
+        now_us += IMU_PERIOD_US;
+        gyro_fusion.integrate(now_us);
+    }
+    CHECK(gyro_fusion.roll_cdeg >= 999 && gyro_fusion.roll_cdeg <= 1001);
+    CHECK(gyro_fusion.pitch_cdeg == 0);
+
+    // A failing burst is counted and leaves the angles alone
+    imu_device.rates_fail = true;
+    int32_t before = gyro_fusion.roll_cdeg;
+    uint32_t failures = gyro_fusion.failures;
+    gyro_fusion.integrate(now_us + IMU_PERIOD_US);
+    CHECK(gyro_fusion.failures == failures + 1);
+    CHECK(gyro_fusion.roll_cdeg == before);
+
+    // Absent (nothing answers), floating (reads all ones), or answering
+    // WHO_AM_I but never giving rates: no gyro
+    plugIn(0x68);
+    fake::i2c_read = nullptr;
+    CHECK(!gyro_fusion.probe(nowUs()));
+    plugIn(0xFF);
+    CHECK(!gyro_fusion.probe(nowUs()));
+    plugIn(0x68);
+    imu_device.rates_fail = true;
+    CHECK(!gyro_fusion.probe(nowUs()));
+    CHECK(gyro_fusion.present == 0);
+
+    // Boot without one: the firmware says so, never polls the bus again,
+    // and the accelerometer alone still plays notes
+    plugIn(0x68);
+    fake::i2c_read = nullptr;
+    bootFirmware();
+    CHECK(fake::log.find("no external imu") != std::string::npos);
+    CHECK(gyro_fusion.present == 0);
+    uint32_t boot_reads = fake::i2c_reads;
+    for (int n = 0; n < 50; n++) {
+        playSample(40.0, 10.0, 10);
+    }
+    CHECK(fake::i2c_reads == boot_reads);
+    CHECK(last_note != 0);
+
+    // Boot with one: found, and polled from its own task
+    plugIn(0x68);
+    bootFirmware();
+    CHECK(fake::log.find("imu found") != std::string::npos);
+    boot_reads = fake::i2c_reads;
+    for (int n = 0; n < 50; n++) {
+        playSample(40.0, 10.0, 10);
+    }
+    CHECK(fake::i2c_reads > boot_reads);
+    return checkDone("test_imu");
+}
@@ -0,0 +1,43 @@
+#include "firmware.h"
+#include "check.h"
+
+// The looper records against millis() and plays back on the scheduler. A
+// one second loop must play the same way whatever the uptime, including
+// past the point where nowUs() wraps (about 71.6 minutes in).
+
+static int playLoop(uint32_t start_ms) {
+    looperClear();
+    looper_press_ms = 0;
+    fake::now_ms = start_ms;
+    looperButton();
+    for (int i = 0; i < 20; i++) {
+        emitNote(static_cast<uint8_t>(60 + i % 5), 80.0f);
+        waitms(50);
+    }
+    looperButton();
+
+    fake::log.clear();
+    for (int i = 0; i < 300; i++) {
+        loop();
+        waitms(10);
+    }
+    int voices = 0;
+    for (size_t pos = 0; (pos = fake::log.find("\nv 1 ", pos)) != std::string::npos; pos++) {
+        voices++;
+    }
+    return voices;
+}
+
+int main() {
+    bootFirmware();
+    int reference = playLoop(1000);
+    printf("%d voice updates from a loop recorded at 1 s\n", reference);
+    CHECK(reference >= 20);
+    const uint32_t starts[] = {4294000, 4294967, 5000000, 0xFFFFF000u};
+    for (uint32_t start_ms : starts) {
+        int voices = playLoop(start_ms);
+        printf("%d voice updates from a loop recorded at %u ms\n", voices, static_cast<unsigned>(start_ms));
+        CHECK(voices == reference);
+    }
+    return checkDone("test_looper");
+}
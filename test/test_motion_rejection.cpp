@@ -0,0 +1,88 @@
+#include "firmware.h"
+#include "check.h"
+#include <algorithm>
+
+// Replays a steady hand with sharp sideways shakes, and a deliberate roll
+// into the next notes, through the sample path with and without the motion
+// rejection stage, counting the note changes each one plays.
+
+typedef Pipeline<DecodeAccel, Chain<OrientAccel, FuseGyro>, AngleFilter, ScaleZones, PitchVolume, Chain<ShowSample, NoteSink>>
+    RejectingPath;
+typedef Pipeline<DecodeAccel, Chain<OrientGravity, FuseGyro>, AngleFilter, ScaleZones, PitchVolume, Chain<ShowSample, NoteSink>>
+    RawPath;
+
+struct Replay {
+    int changes;    // note changes after the first note
+    int reached_ms; // when the step reached its final note, -1 for never
+};
+
+static int16_t counts(double g) {
+    return static_cast<int16_t>(std::max(-32767.0, std::min(32767.0, g * 16384.0 + (rand() % 60 - 30))));
+}
+
+// shake: 0.8 g sideways jerks, 150 ms out of every 400, on a hand held at
+// 10 degrees of roll. step: no shaking, the hand rolls to 55 degrees in
+// 100 ms at t = 2 s.
+template <class Path>
+static Replay replay(bool shake, bool step, uint8_t final_note) {
+    fake::reset();
+    fake::mute = true;
+    srand(1);
+    tilt = TiltEstimator();
+    smooth_primed = 0;
+    stillness = StillnessDetector{{0, 0, 0}, {0, 0, 0}, {0, 0, 0}, 0, STILL_IDLE_MS_DEFAULT, 0, 0};
+    last_note = 0;
+
+    Replay result = {0, -1};
+    int last = -1;
+    for (uint32_t t = 0; t < 20000; t += 10) {
+        double roll = 10.0;
+        if (step && t >= 2000) {
+            roll = t >= 2100 ? 55.0 : 10.0 + 45.0 * (t - 2000) / 100.0;
+        }
+        double r = roll * M_PI / 180.0;
+        double p = 10.0 * M_PI / 180.0;
+        double ax = 0.0, ay = 0.0, az = 0.0;
+        uint32_t phase = t % 400;
+        if (shake && phase < 150) {
+            double s = sin(phase / 150.0 * 2.0 * M_PI);
+            ax = 0.2 * s;
+            ay = 0.8 * s;
+            az = 0.4 * s;
+        }
+        int16_t x = counts(-sin(p) + ax), y = counts(cos(p) * sin(r) + ay), z = counts(cos(p) * cos(r) + az);
+        uint8_t event_data[FW_GET_EVENT_DATA_MAX] = {static_cast<uint8_t>(x), static_cast<uint8_t>(x >> 8), static_cast<uint8_t>(y),
+                                                     static_cast<uint8_t>(y >> 8), static_cast<uint8_t>(z), static_cast<uint8_t>(z >> 8)};
+        Path::run(event_data);
+        if (last_note != last) {
+            result.changes += last >= 0;
+            last = last_note;
+        }
+        if (step && result.reached_ms < 0 && t >= 2000 && last_note == final_note) {
+            result.reached_ms = static_cast<int>(t - 2000);
+        }
+        waitms(10);
+    }
+    return result;
+}
+
+int main() {
+    bootFirmware();
+
+    replay<RawPath>(false, true, 0);
+    uint8_t final_note = last_note; // where the step ends up
+    Replay raw_step = replay<RawPath>(false, true, final_note);
+    Replay rejecting_step = replay<RejectingPath>(false, true, final_note);
+    Replay raw_shake = replay<RawPath>(true, false, 0);
+    Replay rejecting_shake = replay<RejectingPath>(true, false, 0);
+
+    printf("shaking for 20 s: %d note changes raw, %d with rejection\n", raw_shake.changes, rejecting_shake.changes);
+    printf("45 degree roll in 100 ms: note %d reached in %d ms raw, %d ms with rejection\n", final_note,
+           raw_step.reached_ms, rejecting_step.reached_ms);
+
+    CHECK(raw_shake.changes > 100); // the replay really does shake the notes
+    CHECK(rejecting_shake.changes == 0);
+    CHECK(raw_step.reached_ms >= 0);
+    CHECK(rejecting_step.reached_ms >= 0 && rejecting_step.reached_ms <= 300);
+    return checkDone("test_motion_rejection");
+}
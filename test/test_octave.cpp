@@ -0,0 +1,67 @@
+#include "firmware.h"
+#include "check.h"
+
+// The remote's octave keys move the scale root by whole octaves. However far
+// they are pressed, with any root and scale, every note the zones and the
+// arpeggio chords can reach stays within MIDI notes 0..127.
+
+#define CODE_SCALE 0x100
+#define CODE_UP 0x200
+#define CODE_DOWN 0x300
+
+static void press(uint32_t code) {
+    uint8_t event_data[4] = {static_cast<uint8_t>(code), static_cast<uint8_t>(code >> 8), 0, 0};
+    processIrCode(event_data);
+}
+
+static int highestNote() {
+    ScaleQuantizer reach = {scale_quantizer.scale, 0};
+    return scale_quantizer.root + reach.note(ZONE_COUNT - 1 + 4);
+}
+
+int main() {
+    bootFirmware();
+    fake::mute = true;
+    remote.clear();
+    remote.insert(CODE_SCALE, REMOTE_SCALE);
+    remote.insert(CODE_UP, REMOTE_OCTAVE_UP);
+    remote.insert(CODE_DOWN, REMOTE_OCTAVE_DOWN);
+
+    int checked = 0;
+    int out_of_range = 0;
+    for (int root = 0; root <= ROOT_MAX; root++) {
+        root_base = static_cast<uint8_t>(root);
+        octave_shift = 0;
+        applyScaleRoot();
+        for (int scale = 0; scale < SCALE_COUNT; scale++) {
+            for (int i = 0; i < OCTAVE_SHIFT_MAX + 1; i++) {
+                press(CODE_UP);
+            }
+            out_of_range += highestNote() > 127;
+            for (int i = 0; i < 2 * OCTAVE_SHIFT_MAX + 1; i++) {
+                press(CODE_DOWN);
+            }
+            out_of_range += scale_quantizer.root > root;
+            // Up again, then a scale change can leave the shift too high
+            for (int i = 0; i < 2 * OCTAVE_SHIFT_MAX + 1; i++) {
+                press(CODE_UP);
+            }
+            press(CODE_SCALE);
+            out_of_range += highestNote() > 127;
+            checked += 3;
+        }
+    }
+    printf("%d of %d octave positions out of MIDI range\n", out_of_range, checked);
+    CHECK(out_of_range == 0);
+
+    // From the middle the full shift is still available both ways
+    root_base = MIDI_NOTE;
+    octave_shift = 0;
+    scale_quantizer.scale = SCALE_MAJOR;
+    applyScaleRoot();
+    for (int i = 0; i < OCTAVE_SHIFT_MAX + 1; i++) {
+        press(CODE_DOWN);
+    }
+    CHECK(octave_shift == -OCTAVE_SHIFT_MAX && scale_quantizer.root == MIDI_NOTE - 12 * OCTAVE_SHIFT_MAX);
+    return checkDone("test_octave");
+}
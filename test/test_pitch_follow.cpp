@@ -0,0 +1,67 @@
+#include "firmware.h"
+#include "check.h"
+#include <cmath>
+
+// With pitch following on, a held hum moves the scale root to its pitch
+// class. The hums are synthetic magnitude frames with a few harmonics,
+// streamed as multi-slice FFT events through the firmware's event loop.
+
+#define FRAME_BINS 48 // three slices, up to 1.5 kHz
+#define FRAME_MS 32   // 512 points at 16 kHz
+
+static std::vector<uint16_t> humFrame(double hz) {
+    static const double harmonics[] = {3000, 2400, 1200, 600};
+    std::vector<uint16_t> bins(FRAME_BINS);
+    for (int bin = 0; bin < FRAME_BINS; bin++) {
+        double mag = 20;
+        for (int h = 0; h < 4 && hz > 0; h++) {
+            double d = bin - (h + 1) * hz * 16.0 / FFT_BIN_HZ_Q4;
+            mag += harmonics[h] * exp(-d * d / 0.5);
+        }
+        bins[static_cast<size_t>(bin)] = static_cast<uint16_t>(mag);
+    }
+    return bins;
+}
+
+// Frames until the root moves, or -1 if it never does
+static int hum(double hz, int frames) {
+    uint8_t before = scale_quantizer.root;
+    for (int i = 0; i < frames; i++) {
+        playFftFrame(humFrame(hz), FRAME_MS);
+        if (scale_quantizer.root != before) {
+            return i + 1;
+        }
+    }
+    return -1;
+}
+
+int main() {
+    bootFirmware();
+    fake::mute = true;
+    setPitchFollow(1);
+    CHECK(scale_quantizer.root == params.root);
+
+    // A4 held: the root goes to A, within half an octave of middle C
+    int frames = hum(440.0, 20);
+    printf("root %d after %d frames of A4\n", scale_quantizer.root, frames);
+    CHECK(frames == FFT_STABLE_FRAMES + 1); // a frame is judged when the next one starts
+    CHECK(scale_quantizer.root == MIDI_NOTE - 3);
+
+    // A blip shorter than the stable count, then silence, changes nothing
+    CHECK(hum(329.63, FFT_STABLE_FRAMES - 1) == -1);
+    CHECK(hum(0, 10) == -1);
+    CHECK(scale_quantizer.root == MIDI_NOTE - 3);
+
+    // E4 held, then a low A3 taken from its octave harmonic
+    CHECK(hum(329.63, 20) > 0);
+    printf("root %d after E4\n", scale_quantizer.root);
+    CHECK(scale_quantizer.root == MIDI_NOTE + 4);
+    CHECK(hum(220.0, 20) > 0);
+    printf("root %d after A3\n", scale_quantizer.root);
+    CHECK(scale_quantizer.root == MIDI_NOTE - 3);
+
+    // Following off goes back to the configured root
+    setPitchFollow(0);
+    CHECK(scale_quantizer.root == params.root);
+    return checkDone("test_pitch_follow");
+}
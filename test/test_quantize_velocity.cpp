@@ -0,0 +1,61 @@
+#include "firmware.h"
+#include "check.h"
+
+// A fast flick asks for a new note while the clock is running and the
+// quantizer holds it; the hand settles before the grid boundary. The note
+// released on the grid must still start with the flick's velocity, not the
+// pitch volume or the slow speed it has decayed to by then.
+
+static SampleFrame frameFor(uint8_t note, float volume) {
+    SampleFrame frame = {};
+    frame.note = note;
+    frame.volume = volume;
+    return frame;
+}
+
+int main() {
+    bootFirmware();
+    fake::mute = true;
+    params.glide_ms = 0;
+    quantizer.grid = QUANTIZE_16TH;
+    midi_clock.running = 1;
+
+    SampleFrame held = frameFor(MIDI_NOTE, 40.0f);
+    attack.peak_dps = 0;
+    PlayNoteAttack::apply(held);
+    CHECK(last_note == MIDI_NOTE);
+
+    // The flick: the new note is asked for at full speed...
+    uint8_t next = static_cast<uint8_t>(MIDI_NOTE + 2);
+    SampleFrame flick = frameFor(next, 40.0f);
+    attack.peak_dps = ATTACK_FAST_DPS;
+    PlayNoteAttack::apply(flick);
+    CHECK(last_note == MIDI_NOTE);
+
+    // ...and the hand is still by the time the grid comes round
+    attack.peak_dps = 0;
+    for (int i = 0; i < 3; i++) {
+        PlayNoteAttack::apply(flick);
+    }
+    CHECK(last_note == MIDI_NOTE);
+
+    quantizeTick(1);
+    CHECK(last_note == MIDI_NOTE);
+    quantizeTick(QUANTIZE_16TH);
+    CHECK(last_note == next);
+    CHECK(attack_velocity == 127);
+    printf("held note released on the grid at velocity %d\n", attack_velocity);
+
+    // Later samples on the same note keep the velocity it started with
+    PlayNoteAttack::apply(flick);
+    CHECK(attack_velocity == 127);
+
+    // Without a clock the quantizer passes notes through, velocity and all
+    midi_clock.running = 0;
+    SampleFrame slow = frameFor(MIDI_NOTE, 40.0f);
+    PlayNoteAttack::apply(slow);
+    CHECK(last_note == MIDI_NOTE);
+    CHECK(attack_velocity == ATTACK_MIN_VELOCITY);
+
+    return checkDone("test_quantize_velocity");
+}
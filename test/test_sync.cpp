@@ -0,0 +1,178 @@
+#include "../midi/sync.h"
+#include "../midi/sched.h"
+#include "check.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <vector>
+
+// A deterministic radio link between one leader and one follower ClockSync.
+// Both clocks are millisecond counters scaled to microseconds, as on the
+// device, each with its own drift and boot offset. Beacons take 1.5 to
+// 3.5 ms, some are lost and some are picked up a busy loop pass late. The
+// follower polls once per millisecond. Arpeggiator-style steps on both
+// sides are compared once the follower has locked.
+
+struct LinkModel {
+    const char *name;
+    double leader_ppm;
+    double follower_ppm;
+    uint32_t leader_boot_ms; // clock reading at t = 0
+    uint32_t follower_boot_ms;
+    int loss_percent;
+    int late_percent; // picked up 20 ms late
+    double seconds;
+};
+
+struct LinkResult {
+    double lock_s;      // -1 for never
+    double max_error_us; // follower's shared time against the leader's, after settling
+    double worst_step_us; // the same grid step on both sides
+    int grid_steps;
+    bool grid_even;     // every leader step is exactly one interval on the 64 bit shared clock
+    uint32_t resteps;
+};
+
+#define STEP_US 125000u
+#define SETTLE_US 30e6 // after lock, for the drift estimate to converge
+
+static uint32_t lcg = 12345;
+
+static uint32_t rnd() {
+    lcg = lcg * 1103515245u + 12345u;
+    return lcg >> 8;
+}
+
+static LinkResult run(const LinkModel &model) {
+    lcg = 12345;
+    ClockSync leader = {}, follower = {};
+    leader.role = SYNC_LEADER;
+    follower.role = SYNC_FOLLOWER;
+    struct Packet {
+        double arrive;
+        uint8_t bytes[SYNC_BEACON_BYTES];
+    };
+    std::deque<Packet> air;
+
+    auto leaderUs = [&](double t) {
+        return static_cast<uint32_t>(static_cast<uint32_t>(floor(t * (1 + model.leader_ppm * 1e-6) / 1000)) + model.leader_boot_ms) * 1000u;
+    };
+    auto followerUs = [&](double t) {
+        return static_cast<uint32_t>(static_cast<uint32_t>(floor(t * (1 + model.follower_ppm * 1e-6) / 1000)) + model.follower_boot_ms) * 1000u;
+    };
+
+    LinkResult result = {-1, 0, 0, 0, true, 0};
+    uint32_t next_beacon = leaderUs(0);
+    leader.shared_ref = next_beacon;
+    uint32_t leader_next = 0, follower_next = 0;
+    uint64_t last_grid = 0;
+    std::vector<double> leader_steps, follower_steps; // when each side stepped
+    for (double t = 0; t < model.seconds * 1e6; t += 100) {
+        uint32_t leader_us = leaderUs(t), follower_us = followerUs(t);
+        if (timeReached(leader_us, next_beacon)) {
+            Packet packet;
+            leader.track(next_beacon);
+            syncBeacon(packet.bytes, leader.seq++, leader.shared_ref);
+            packet.arrive = t + 1500 + rnd() % 2000 + (static_cast<int>(rnd() % 100) < model.late_percent ? 20000 : 0);
+            if (static_cast<int>(rnd() % 100) >= model.loss_percent) {
+                air.push_back(packet);
+            }
+            next_beacon += SYNC_BEACON_MS * 1000u;
+        }
+        bool poll = fmod(t, 1000) < 1;
+        if (poll && !air.empty() && air.front().arrive <= t) {
+            Packet packet = air.front();
+            air.pop_front();
+            for (int i = 0; i < SYNC_BEACON_BYTES; i++) {
+                uint32_t shared_us;
+                if (follower.feed(packet.bytes[i], shared_us)) {
+                    follower.onBeacon(shared_us, follower_us);
+                }
+            }
+            if (follower.locked && result.lock_s < 0) {
+                result.lock_s = t / 1e6;
+            }
+        }
+        if (!poll || result.lock_s < 0 || t < result.lock_s * 1e6 + SETTLE_US) {
+            continue;
+        }
+        double error = static_cast<int32_t>(follower.sharedTime(follower_us) - leader_us);
+        result.max_error_us = std::max(result.max_error_us, fabs(error));
+        if (!leader_next) {
+            leader_next = leader.nextGrid(leader_us + STEP_US / 2, STEP_US);
+            follower_next = follower.nextGrid(follower_us + STEP_US / 2, STEP_US);
+            last_grid = leader.extend(leader_next);
+        }
+        if (timeReached(leader_us, leader_next)) {
+            leader_steps.push_back(t);
+            leader_next = leader.nextGrid(leader_us + STEP_US / 2, STEP_US);
+            uint64_t grid = leader.extend(leader_next);
+            result.grid_even = result.grid_even && grid - last_grid == STEP_US;
+            last_grid = grid;
+        }
+        if (timeReached(follower_us, follower_next)) {
+            follower_steps.push_back(t);
+            follower_next = follower.nextGrid(follower_us + STEP_US / 2, STEP_US);
+        }
+    }
+    // Each follower step against the nearest leader step, up to the last
+    // one the leader got to before the run ended
+    for (double t : follower_steps) {
+        auto at = std::lower_bound(leader_steps.begin(), leader_steps.end(), t);
+        if (at == leader_steps.end()) {
+            break;
+        }
+        double nearest = *at - t;
+        if (at != leader_steps.begin()) {
+            nearest = std::min(nearest, t - *(at - 1));
+        }
+        result.worst_step_us = std::max(result.worst_step_us, nearest);
+    }
+    result.grid_steps = static_cast<int>(follower_steps.size());
+    result.resteps = follower.steps;
+    return result;
+}
+
+static LinkResult report(const LinkModel &model) {
+    LinkResult result = run(model);
+    printf("%s: locked after %.1f s, error at most %.0f us, %d steps at most %.0f us apart, %u re-anchors\n", model.name,
+           result.lock_s, result.max_error_us, result.grid_steps, result.worst_step_us, static_cast<unsigned>(result.resteps));
+    return result;
+}
+
+int main() {
+    // The wrap of the 32 bit microsecond clocks, 4294967 ms after boot
+    const uint32_t wrap_ms = 4294967u;
+
+    LinkResult drift = report({"100 ppm drift", 30, -70, 123, 987, 5, 2, 300});
+    CHECK(drift.lock_s >= 0 && drift.lock_s < 10);
+    CHECK(drift.max_error_us <= 2500);
+    CHECK(drift.worst_step_us <= 2500);
+    CHECK(drift.grid_steps > 2000);
+    CHECK(drift.grid_even);
+    CHECK(drift.resteps == 0);
+
+    LinkResult fast = report({"800 ppm drift", 400, -400, 5000, 70, 5, 2, 300});
+    CHECK(fast.lock_s >= 0);
+    CHECK(fast.max_error_us <= 3000);
+    CHECK(fast.worst_step_us <= 3000);
+
+    LinkResult lossy = report({"30% dropped, 10% late", 30, -70, 123, 987, 30, 10, 300});
+    CHECK(lossy.lock_s >= 0 && lossy.lock_s < 20);
+    CHECK(lossy.worst_step_us <= 3000);
+    CHECK(lossy.resteps == 0);
+
+    // Both clocks wrap during the run, the leader first; steps stay one
+    // interval apart across it and the follower stays on them
+    LinkResult wrap = report({"clocks wrapping", 30, -70, wrap_ms - 60000, wrap_ms - 90000, 5, 2, 180});
+    CHECK(wrap.lock_s >= 0);
+    CHECK(wrap.grid_even);
+    CHECK(wrap.worst_step_us <= 2500);
+    CHECK(wrap.resteps == 0);
+
+    // A leader that has wrapped many times before the follower boots
+    LinkResult late = report({"late follower", 30, -70, 40 * wrap_ms + 5000, 10, 5, 2, 120});
+    CHECK(late.lock_s >= 0);
+    CHECK(late.worst_step_us <= 2500);
+    return checkDone("test_sync");
+}
@@ -0,0 +1,55 @@
+#include "firmware.h"
+#include "check.h"
+#include <cstring>
+
+// Trace blocks fill from the sample path and are written by TASK_TRACE: no
+// file write may happen inside a sample, the blocks must come out in order
+// with every record, and closing writes what is left.
+
+int main() {
+    bootFirmware();
+    fake::mute = true;
+    fake::card = true;
+    CHECK(trace.open(millis()));
+    uint32_t header_writes = fake::writes;
+
+    const int samples = 1000;
+    bool wrote_in_sample = false;
+    for (int n = 0; n < samples; n++) {
+        int16_t x = static_cast<int16_t>(n);
+        uint8_t event_data[FW_GET_EVENT_DATA_MAX] = {static_cast<uint8_t>(x), static_cast<uint8_t>(x >> 8), 0, 0, 0, 0x40};
+        uint32_t before = fake::writes;
+        SampleFrame frame;
+        DecodeAccel::apply(event_data, frame);
+        wrote_in_sample = wrote_in_sample || fake::writes != before;
+        schedRun(nowUs());
+        waitms(10);
+    }
+    CHECK(!wrote_in_sample);
+    uint32_t full_blocks = samples / (TRACE_BLOCK_RECORDS - 1);
+    CHECK(fake::writes - header_writes == full_blocks);
+    trace.close();
+    CHECK(fake::writes - header_writes == full_blocks + 1);
+
+    // Walk the file: header, then blocks in order holding every sample
+    const uint8_t *file = fake::written.data();
+    CHECK(fake::written.size() == sizeof(TraceFileHeader) + (full_blocks + 1) * sizeof(TraceBlock));
+    int records = 0;
+    int16_t expect = 0;
+    bool in_order = true;
+    for (uint32_t b = 0; b <= full_blocks; b++) {
+        TraceBlock block;
+        memcpy(&block, file + sizeof(TraceFileHeader) + b * sizeof(TraceBlock), sizeof(block));
+        in_order = in_order && block.header.block == b;
+        in_order = in_order && block.header.crc == traceCrc(reinterpret_cast<const uint8_t *>(block.records),
+                                                             block.header.count * sizeof(TraceRecord));
+        for (int i = 0; i < block.header.count; i++) {
+            in_order = in_order && block.records[i].kind == TRACE_SAMPLE && block.records[i].value[0] == expect++;
+            records++;
+        }
+    }
+    printf("%d samples traced in %u blocks, none written from the sample path\n", records, static_cast<unsigned>(full_blocks + 1));
+    CHECK(in_order);
+    CHECK(records == samples);
+    return checkDone("test_trace");
+}
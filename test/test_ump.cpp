@@ -0,0 +1,189 @@
+#define UMP_OUTPUT 1
+#include "firmware.h"
+#include "check.h"
+#include <random>
+#include <vector>
+
+// MIDI 2.0 output taken back apart. Boot goes through the firmware's own
+// UART sink, byte order included; after that an in-memory sink keeps every
+// batch. Checked: every encoder field, batches never splitting a packet,
+// the bend range RPN, note on/off with 16 bit velocity and the 7.9 pitch
+// attribute, and the glide bend at 32 bits.
+
+struct Packet {
+    int type, status, channel, index, extra;
+    uint32_t value;
+    bool operator==(const Packet &) const = default;
+};
+
+static std::vector<uint32_t> words;
+static std::vector<int> batches;
+
+static void memorySink(const uint32_t *batch, int count) {
+    words.insert(words.end(), batch, batch + count);
+    batches.push_back(count);
+}
+
+static std::vector<Packet> decode(const std::vector<uint32_t> &in) {
+    std::vector<Packet> out;
+    for (size_t i = 0; i < in.size();) {
+        int type = static_cast<int>(in[i] >> 28);
+        if (type == UMP_TYPE_SYSTEM) {
+            out.push_back({type, static_cast<int>(in[i] >> 16 & 0xFF), 0, 0, 0, 0});
+            i++;
+        } else if (type == UMP_TYPE_VOICE2 && i + 1 < in.size()) {
+            out.push_back({type, static_cast<int>(in[i] >> 20 & 0xF), static_cast<int>(in[i] >> 16 & 0xF),
+                           static_cast<int>(in[i] >> 8 & 0x7F), static_cast<int>(in[i] & 0xFF), in[i + 1]});
+            i += 2;
+        } else {
+            out.push_back({-1, 0, 0, 0, 0, 0});
+            break;
+        }
+    }
+    return out;
+}
+
+static void startCapture() {
+    words.clear();
+    batches.clear();
+    ump.flush();
+    ump.sink = memorySink;
+}
+
+static void encoders() {
+    std::mt19937 rng(75);
+    std::vector<Packet> sent;
+    UmpBuffer buffer = {};
+    buffer.sink = memorySink;
+    words.clear();
+    batches.clear();
+    for (int n = 0; n < 100000; n++) {
+        uint8_t channel = static_cast<uint8_t>(rng() & 15), a = static_cast<uint8_t>(rng() & 127), b = static_cast<uint8_t>(rng() & 127);
+        uint32_t value = static_cast<uint32_t>(rng());
+        uint16_t velocity = static_cast<uint16_t>(rng()), pitch = static_cast<uint16_t>(rng());
+        switch (rng() % 6) {
+        case 0:
+            buffer.noteOn(channel, a, velocity, pitch);
+            sent.push_back({UMP_TYPE_VOICE2, UMP_NOTE_ON, channel, a, UMP_ATTRIBUTE_PITCH, static_cast<uint32_t>(velocity) << 16 | pitch});
+            break;
+        case 1:
+            buffer.noteOff(channel, a);
+            sent.push_back({UMP_TYPE_VOICE2, UMP_NOTE_OFF, channel, a, 0, 0});
+            break;
+        case 2:
+            buffer.control(channel, a, value);
+            sent.push_back({UMP_TYPE_VOICE2, UMP_CONTROL, channel, a, 0, value});
+            break;
+        case 3:
+            buffer.pitchBend(channel, value);
+            sent.push_back({UMP_TYPE_VOICE2, UMP_PITCH_BEND, channel, 0, 0, value});
+            break;
+        case 4:
+            buffer.registeredControl(channel, a, b, value);
+            sent.push_back({UMP_TYPE_VOICE2, UMP_REGISTERED_CONTROL, channel, a, b, value});
+            break;
+        default: {
+            uint8_t status = static_cast<uint8_t>(MIDI_CLOCK + rng() % 5);
+            buffer.realtime(status);
+            sent.push_back({UMP_TYPE_SYSTEM, status, 0, 0, 0, 0});
+        }
+        }
+        if (rng() % 50 == 0) {
+            buffer.flush();
+        }
+    }
+    buffer.flush();
+
+    bool whole = true; // every batch ends on a packet boundary
+    size_t at = 0;
+    for (int count : batches) {
+        size_t end = at + static_cast<size_t>(count);
+        while (at < end) {
+            at += (words[at] >> 28) == UMP_TYPE_VOICE2 ? 2 : 1;
+        }
+        whole = whole && at == end;
+    }
+    printf("encoders: %zu packets in %zu batches round trip\n", sent.size(), batches.size());
+    CHECK(decode(words) == sent);
+    CHECK(whole);
+    CHECK(buffer.packets == sent.size());
+}
+
+int main() {
+    encoders();
+
+    // Boot through the UART sink: the first packet is the bend range, RPN
+    // 0 with the semitones in the top 7 bits and no cents
+    fake::reset();
+    fake::mute = true;
+    bootFirmware();
+    std::vector<uint32_t> uart_words;
+    for (size_t i = 0; i + 3 < fake::uart_out.size(); i += 4) {
+        uart_words.push_back(static_cast<uint32_t>(fake::uart_out[i]) << 24 | static_cast<uint32_t>(fake::uart_out[i + 1]) << 16 |
+                             static_cast<uint32_t>(fake::uart_out[i + 2]) << 8 | fake::uart_out[i + 3]);
+    }
+    std::vector<Packet> boot = decode(uart_words);
+    CHECK(fake::uart_out.size() % 4 == 0);
+    CHECK(!boot.empty() && boot[0].type == UMP_TYPE_VOICE2 && boot[0].status == UMP_REGISTERED_CONTROL &&
+          boot[0].channel == MIDI_CHANNEL && boot[0].index == 0 && boot[0].extra == 0);
+    CHECK(!boot.empty() && boot[0].value >> 25 == GLIDE_BEND_RANGE && (boot[0].value & 0x01FFFFFF) == 0);
+
+    // A note, then the next zone up: off for the old one, on for the new
+    // one with the attack velocity at 16 bits and its pitch as 7.9
+    startCapture();
+    params.glide_ms = 0;
+    for (int n = 0; n < 5; n++) {
+        playSample(0.0, 0.0, 10);
+    }
+    uint8_t first = last_note;
+    startCapture();
+    for (int n = 0; n < 5; n++) {
+        playSample(30.0, 0.0, 10);
+    }
+    uint8_t second = last_note;
+    CHECK(second != first);
+    std::vector<Packet> change = decode(words);
+    std::vector<Packet> notes;
+    for (const Packet &packet : change) {
+        if (packet.status == UMP_NOTE_ON || packet.status == UMP_NOTE_OFF) {
+            notes.push_back(packet);
+        }
+    }
+    CHECK(notes.size() == 2);
+    if (notes.size() == 2) {
+        CHECK(notes[0].status == UMP_NOTE_OFF && notes[0].index == first);
+        CHECK(notes[1].status == UMP_NOTE_ON && notes[1].index == second && notes[1].extra == UMP_ATTRIBUTE_PITCH);
+        CHECK(notes[1].value >> 16 == umpScale7to16(attack_velocity));
+        CHECK((notes[1].value & 0xFFFF) >> 9 == second && (notes[1].value & 0x1FF) == 0);
+        printf("note %d -> %d, velocity %d as 0x%04x\n", first, second, attack_velocity, notes[1].value >> 16);
+    }
+
+    // Glide back down: the 32 bit bend follows the 14 bit one the text
+    // output gets, ramps one way and lands on the interval
+    params.glide_ms = 100;
+    startCapture();
+    for (int n = 0; n < 3; n++) {
+        playSample(0.0, 0.0, 10);
+    }
+    for (int n = 0; n < 40; n++) {
+        loop();
+        waitms(5);
+    }
+    std::vector<uint32_t> bends;
+    for (const Packet &packet : decode(words)) {
+        if (packet.status == UMP_PITCH_BEND) {
+            bends.push_back(packet.value);
+        }
+    }
+    bool falling = true;
+    for (size_t i = 1; i < bends.size(); i++) {
+        falling = falling && bends[i] < bends[i - 1];
+    }
+    int32_t landed = GlideRamp::bendFor(static_cast<int>(first) - static_cast<int>(second));
+    printf("glide %d -> %d: %zu bends, ending at 0x%08x\n", second, first, bends.size(), bends.empty() ? 0u : bends.back());
+    CHECK(bends.size() > 10);
+    CHECK(falling);
+    CHECK(!bends.empty() && bends.back() == UMP_BEND_CENTER + static_cast<uint32_t>(landed << 18));
+    CHECK(!bends.empty() && static_cast<int>(bends.back() >> 18) - GLIDE_BEND_CENTER == glide.sent);
+    return checkDone("test_ump");
+}
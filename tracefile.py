@@ -0,0 +1,177 @@
+"""Theremini trace files: accelerometer samples and emitted notes.
+
+The layout is shared with midi/trace.h, which has the full description.
+Records and block headers are 16 bytes, and blocks of BLOCK_RECORDS records
+follow a 16 byte file header. Because the blocks sit at a fixed stride,
+their headers double as the time index. TraceReader memory maps the file,
+so a seek is a binary search over the block headers and iteration only
+touches the pages it reads, however large the capture.
+"""
+import bisect
+import mmap
+import struct
+import sys
+import zlib
+
+MAGIC = 0x52544D54  # "TMTR"
+VERSION = 1
+RECORD_BYTES = 16
+BLOCK_RECORDS = 64
+BLOCK_BYTES = RECORD_BYTES * BLOCK_RECORDS
+VALUES = 5
+
+SAMPLE = 1  # raw x, y, z counts
+NOTE = 2    # note, velocity (0 = off); channel 0 is live, 1.. looper voices
+CC = 3      # controller, value
+BEND = 4    # signed pitch bend, 0 is the center
+TEMP = 5    # raw temperature reading, each time the device checks it
+GYRO = 6    # raw x, y, z gyro counts per read; channel 1 is the boot bias
+KIND_NAMES = {SAMPLE: "sample", NOTE: "note", CC: "cc", BEND: "bend", TEMP: "temp", GYRO: "gyro"}
+
+FILE_HEADER = struct.Struct("<IHHHHI")
+BLOCK_HEADER = struct.Struct("<IIIHH")
+RECORD = struct.Struct("<IBB5h")
+
+
+class TraceWriter:
+    """Writes the same blocks as the device, e.g. from the host bridge."""
+
+    def __init__(self, path: str, start_ms: int = 0):
+        self.file = open(path, "wb")
+        self.file.write(FILE_HEADER.pack(MAGIC, VERSION, RECORD_BYTES, BLOCK_RECORDS, 0, start_ms))
+        self.records = []
+        self.block = 0
+
+    def add(self, time_ms: int, kind: int, channel: int, *values: int):
+        values = tuple(values) + (0,) * (VALUES - len(values))
+        self.records.append(RECORD.pack(time_ms & 0xFFFFFFFF, kind, channel, *values))
+        if len(self.records) == BLOCK_RECORDS - 1:
+            self.flush()
+
+    def flush(self):
+        if not self.records:
+            return
+        data = b"".join(self.records)
+        first = RECORD.unpack_from(self.records[0])[0]
+        last = RECORD.unpack_from(self.records[-1])[0]
+        header = BLOCK_HEADER.pack(first, last, zlib.crc32(data), len(self.records), self.block & 0xFFFF)
+        self.file.write(header + data + bytes(BLOCK_BYTES - RECORD_BYTES - len(data)))
+        self.records = []
+        self.block += 1
+
+    def close(self):
+        self.flush()
+        self.file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+
+class _FirstTimes:
+    """Block first times as a sequence, read from the map on demand."""
+
+    def __init__(self, reader):
+        self.reader = reader
+
+    def __len__(self):
+        return len(self.reader)
+
+    def __getitem__(self, index):
+        return self.reader.block_header(index)[0]
+
+
+class TraceReader:
+    def __init__(self, path: str):
+        self.file = open(path, "rb")
+        self.map = mmap.mmap(self.file.fileno(), 0, access=mmap.ACCESS_READ)
+        if len(self.map) < FILE_HEADER.size:
+            raise ValueError(f"{path}: too short for a trace")
+        magic, version, record_bytes, block_records, _, self.start_ms = FILE_HEADER.unpack_from(self.map)
+        if magic != MAGIC or version != VERSION or record_bytes != RECORD_BYTES or block_records != BLOCK_RECORDS:
+            raise ValueError(f"{path}: not a version {VERSION} trace")
+        # A block cut short by a crash or a full card is left out
+        self.blocks = (len(self.map) - FILE_HEADER.size) // BLOCK_BYTES
+        self.bad_blocks = 0
+
+    def __len__(self):
+        return self.blocks
+
+    def close(self):
+        self.map.close()
+        self.file.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *exc):
+        self.close()
+
+    def _offset(self, index: int) -> int:
+        return FILE_HEADER.size + index * BLOCK_BYTES
+
+    def block_header(self, index: int):
+        """(first_ms, last_ms, crc, count, block number)"""
+        return BLOCK_HEADER.unpack_from(self.map, self._offset(index))
+
+    def block_ok(self, index: int) -> bool:
+        _, _, crc, count, number = self.block_header(index)
+        if count >= BLOCK_RECORDS or number != index & 0xFFFF:
+            return False
+        start = self._offset(index) + RECORD_BYTES
+        return zlib.crc32(self.map[start:start + count * RECORD_BYTES]) == crc
+
+    def seek(self, time_ms: int) -> int:
+        """Index of the block holding the first record at or after time_ms."""
+        index = bisect.bisect_right(_FirstTimes(self), time_ms) - 1
+        if index < 0:
+            return 0
+        # The record may be the first of the next block
+        if self.block_header(index)[1] < time_ms:
+            index += 1
+        return index
+
+    def records(self, start_ms: int = None, end_ms: int = None, verify: bool = True):
+        """Yield (time_ms, kind, channel, values) from start_ms up to end_ms.
+
+        Blocks that fail their checksum are skipped and counted in bad_blocks.
+        """
+        index = 0 if start_ms is None else self.seek(start_ms)
+        for index in range(index, self.blocks):
+            first, _, _, count, _ = self.block_header(index)
+            if end_ms is not None and first > end_ms:
+                return
+            if verify and not self.block_ok(index):
+                self.bad_blocks += 1
+                continue
+            start = self._offset(index) + RECORD_BYTES
+            view = memoryview(self.map)[start:start + count * RECORD_BYTES]
+            try:
+                for time_ms, kind, channel, *values in RECORD.iter_unpack(view):
+                    if start_ms is not None and time_ms < start_ms:
+                        continue
+                    if end_ms is not None and time_ms > end_ms:
+                        return
+                    yield time_ms, kind, channel, values
+            finally:
+                view.release()
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: python tracefile.py FILE [START_MS [END_MS]]")
+        return
+    start_ms = int(sys.argv[2]) if len(sys.argv) > 2 else None
+    end_ms = int(sys.argv[3]) if len(sys.argv) > 3 else None
+    with TraceReader(sys.argv[1]) as reader:
+        for time_ms, kind, channel, values in reader.records(start_ms, end_ms):
+            name = KIND_NAMES.get(kind, str(kind))
+            print(f"{time_ms} {name} {channel} {' '.join(str(v) for v in values[:3])}")
+        if reader.bad_blocks:
+            print(f"{reader.bad_blocks} blocks failed their checksum")
+
+
+if __name__ == "__main__":
+    main()